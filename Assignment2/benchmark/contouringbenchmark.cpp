@@ -0,0 +1,851 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+// Headless benchmark of the contouring kernels used by the MarchingSquares
+// processor. It only depends on the processor-independent sources of the module
+// (coherentextraction, contourfollowing, contourgeometry, gaussianfilter,
+// isobandextraction, minmaxpyramid, rawfield, streamingextraction) and glm.
+//
+// Usage:
+//   contouringbenchmark [--size NX NY] [--levels K] [--repeat R] [--threads T]
+//                       [--sigma S] [--format csv|json]
+//                       [--raw FILE NX NY TYPE [HEADERBYTES]] [--verify]
+//
+// TYPE is one of int8, uint8, int16, uint16, int32, uint32, float32, float64.
+// Every benchmark prints one record with the field, data format, mode, decider,
+// the median time over R runs, ns/cell, cells/s, the active cell ratio and the
+// number of vertices emitted. csv (default) prints a header line first, json
+// prints one object per line.
+//
+// --verify runs no benchmarks. It checks that the results the kernels promise to
+// be the same are, on the synthetic fields and with both deciders: extraction on
+// 1 and T threads (4 if T is 0 or 1), the polylines of contour following and of
+// the polyline extraction, contours joined from pieces after a local change and a
+// full extraction of the changed field, streamed tiles (with and without the
+// filter) and an in-core extraction, and the compact working copy and the field
+// it was made from. It prints field,check,result lines and exits with 2 if any
+// check failed.
+
+#include <labmarchingsquares/coherentextraction.h>
+#include <labmarchingsquares/contourfollowing.h>
+#include <labmarchingsquares/gaussianfilter.h>
+#include <labmarchingsquares/isobandextraction.h>
+#include <labmarchingsquares/minmaxpyramid.h>
+#include <labmarchingsquares/polylineextraction.h>
+#include <labmarchingsquares/rawfield.h>
+#include <labmarchingsquares/segmentextraction.h>
+#include <labmarchingsquares/streamingextraction.h>
+#include <labmarchingsquares/workingfield.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace inviwo;
+using namespace inviwo::contouring;
+
+namespace
+{
+
+struct Options
+{
+    size_t nx = 1024;
+    size_t ny = 1024;
+    size_t levels = 8;
+    size_t repeat = 5;
+    size_t threads = 0;
+    float sigma = 1.0f;
+    bool json = false;
+    bool verify = false;
+
+    std::string rawFile;
+    size_t rawNx = 0;
+    size_t rawNy = 0;
+    RawType rawType = RawType::Float32;
+    size_t rawOffset = 0;
+};
+
+struct Record
+{
+    std::string field;
+    std::string format;
+    std::string mode;
+    std::string decider;
+    size_t cells = 0;
+    double milliseconds = 0.0;
+    double activeRatio = 0.0;
+    size_t vertices = 0;
+};
+
+void printUsage()
+{
+    std::fprintf(stderr,
+        "usage: contouringbenchmark [--size NX NY] [--levels K] [--repeat R] [--threads T]\n"
+        "                           [--sigma S] [--format csv|json]\n"
+        "                           [--raw FILE NX NY TYPE [HEADERBYTES]] [--verify]\n");
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    auto number = [&](int i) { return static_cast<size_t>(std::strtoull(argv[i], nullptr, 10)); };
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const int left = argc - i - 1;
+        if (arg == "--size" && left >= 2)
+        {
+            options.nx = number(++i);
+            options.ny = number(++i);
+        }
+        else if (arg == "--levels" && left >= 1) options.levels = number(++i);
+        else if (arg == "--repeat" && left >= 1) options.repeat = std::max<size_t>(1, number(++i));
+        else if (arg == "--threads" && left >= 1) options.threads = number(++i);
+        else if (arg == "--sigma" && left >= 1) options.sigma = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--format" && left >= 1) options.json = std::string(argv[++i]) == "json";
+        else if (arg == "--verify") options.verify = true;
+        else if (arg == "--raw" && left >= 4)
+        {
+            options.rawFile = argv[++i];
+            options.rawNx = number(++i);
+            options.rawNy = number(++i);
+            if (!parseRawType(argv[++i], options.rawType)) return false;
+            if (i + 1 < argc && argv[i + 1][0] != '-') options.rawOffset = number(++i);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return options.nx >= 2 && options.ny >= 2;
+}
+
+// Synthetic fields with values in [0, 1]
+enum class Synthetic
+{
+    Smooth,  // a few periods of sinusoids, long and mostly open isolines
+    Noise,   // white noise, about half of the cells are active for every level
+    Checker  // alternating samples, every cell is a saddle
+};
+
+std::vector<float> makeField(Synthetic kind, size_t nx, size_t ny)
+{
+    std::vector<float> values(nx * ny);
+    std::mt19937 random(17);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    for (size_t j = 0; j < ny; j++)
+    {
+        for (size_t i = 0; i < nx; i++)
+        {
+            float v = 0.0f;
+            switch (kind)
+            {
+            case Synthetic::Smooth:
+                v = 0.5f + 0.25f * std::sin(12.0f * i / nx) * std::cos(9.0f * j / ny) +
+                    0.25f * std::sin(5.0f * (i + j) / (nx + ny));
+                break;
+            case Synthetic::Noise:
+                v = uniform(random);
+                break;
+            case Synthetic::Checker:
+                v = ((i + j) % 2 ? 0.9f : 0.1f) + 0.05f * uniform(random);
+                break;
+            }
+            values[j * nx + i] = v;
+        }
+    }
+    return values;
+}
+
+// Field stored in the element type T, scaled from [lo, hi] to the range of T
+// for integer types
+template <typename T>
+std::vector<T> convertField(const std::vector<float>& values, float lo, float hi)
+{
+    std::vector<T> result(values.size());
+    const bool integral = std::numeric_limits<T>::is_integer;
+    const double scale = integral
+        ? (static_cast<double>(std::numeric_limits<T>::max()) - std::numeric_limits<T>::lowest()) / (hi - lo)
+        : 1.0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        result[i] = integral
+            ? static_cast<T>(std::numeric_limits<T>::lowest() + std::floor((values[i] - lo) * scale))
+            : static_cast<T>(values[i]);
+    }
+    return result;
+}
+
+template <typename Func>
+double medianMilliseconds(size_t repeat, Func&& func)
+{
+    std::vector<double> times;
+    for (size_t r = 0; r < repeat; r++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+void printRecord(const Record& record, bool json)
+{
+    const double nsPerCell = record.cells ? record.milliseconds * 1e6 / record.cells : 0.0;
+    const double cellsPerSecond = record.milliseconds > 0.0 ? record.cells / (record.milliseconds * 1e-3) : 0.0;
+    if (json)
+    {
+        std::printf("{\"field\":\"%s\",\"format\":\"%s\",\"mode\":\"%s\",\"decider\":\"%s\",\"cells\":%zu,"
+            "\"ms\":%.4f,\"ns_per_cell\":%.4f,\"cells_per_s\":%.1f,\"active_ratio\":%.6f,\"vertices\":%zu}\n",
+            record.field.c_str(), record.format.c_str(), record.mode.c_str(), record.decider.c_str(),
+            record.cells, record.milliseconds, nsPerCell, cellsPerSecond, record.activeRatio, record.vertices);
+    }
+    else
+    {
+        std::printf("%s,%s,%s,%s,%zu,%.4f,%.4f,%.1f,%.6f,%zu\n", record.field.c_str(), record.format.c_str(),
+            record.mode.c_str(), record.decider.c_str(), record.cells, record.milliseconds, nsPerCell,
+            cellsPerSecond, record.activeRatio, record.vertices);
+    }
+    std::fflush(stdout);
+}
+
+// Fraction of cells that are active for at least one of the isovalues [begin, end)
+template <typename T>
+double activeRatio(const FieldView<T>& field, const double* begin, const double* end)
+{
+    size_t active = 0;
+    for (size_t iy = 0; iy + 1 < field.ny; iy++)
+    {
+        for (size_t ix = 0; ix + 1 < field.nx; ix++)
+        {
+            const float f[] = { field(ix, iy), field(ix, iy + 1), field(ix + 1, iy + 1), field(ix + 1, iy) };
+            if (straddlesAny(*std::min_element(f, f + 4), *std::max_element(f, f + 4), begin, end)) active++;
+        }
+    }
+    return static_cast<double>(active) / ((field.nx - 1) * (field.ny - 1));
+}
+
+// Evenly spaced isovalues strictly inside the value range of field, like the processor does
+template <typename T>
+std::vector<double> fieldIsovalues(const FieldView<T>& field, size_t levels)
+{
+    float lo = std::numeric_limits<float>::max();
+    float hi = std::numeric_limits<float>::lowest();
+    for (size_t j = 0; j < field.ny; j++)
+    {
+        for (size_t i = 0; i < field.nx; i++)
+        {
+            lo = std::min(lo, field(i, j));
+            hi = std::max(hi, field(i, j));
+        }
+    }
+    std::vector<double> isoValues;
+    for (size_t k = 0; k < levels; k++)
+    {
+        isoValues.push_back(lo + (k + 1) * (static_cast<double>(hi) - lo) / (levels + 1));
+    }
+    return isoValues;
+}
+
+// Pyramid and seed builds and all extraction modes with both deciders on one field
+template <typename T>
+void benchmarkExtraction(const std::string& name, const std::string& format, const FieldView<T>& field,
+    const Options& options)
+{
+    const std::vector<double> isoValues = fieldIsovalues(field, options.levels);
+    const double* begin = isoValues.data();
+    const double* end = isoValues.data() + isoValues.size();
+
+    Record record;
+    record.field = name;
+    record.format = format;
+    record.cells = (field.nx - 1) * (field.ny - 1);
+    record.activeRatio = activeRatio(field, begin, end);
+
+    MinMaxPyramid pyramid;
+    record.mode = "pyramid";
+    record.decider = "-";
+    record.milliseconds = medianMilliseconds(options.repeat, [&]() { pyramid.build(field, options.threads); });
+    printRecord(record, options.json);
+
+    ContourSeeds seeds;
+    record.mode = "seeds";
+    record.milliseconds = medianMilliseconds(options.repeat, [&]() { seeds.build(field); });
+    printRecord(record, options.json);
+
+    const char* deciderNames[] = { "midpoint", "asymptotic" };
+    for (int d = 0; d < 2; d++)
+    {
+        const auto decider = static_cast<Decider>(d);
+        record.decider = deciderNames[d];
+
+        std::vector<std::vector<glm::vec2>> segments;
+        record.mode = "segments";
+        record.milliseconds = medianMilliseconds(options.repeat, [&]()
+        {
+            extractSegments(field, begin, end, decider, &pyramid, segments, options.threads);
+        });
+        record.vertices = 0;
+        for (const auto& points : segments) record.vertices += points.size();
+        printRecord(record, options.json);
+
+        std::vector<ContourGeometry> contours;
+        record.mode = "polylines";
+        record.milliseconds = medianMilliseconds(options.repeat, [&]()
+        {
+            extractPolylines(field, begin, end, decider, contours, &pyramid, options.threads);
+        });
+        record.vertices = 0;
+        for (const auto& contour : contours) record.vertices += contour.vertices.size();
+        printRecord(record, options.json);
+
+        record.mode = "following";
+        record.milliseconds = medianMilliseconds(options.repeat, [&]()
+        {
+            followContours(field, begin, end, decider, seeds, contours, options.threads);
+        });
+        record.vertices = 0;
+        for (const auto& contour : contours) record.vertices += contour.vertices.size();
+        printRecord(record, options.json);
+    }
+}
+
+void benchmarkFilter(const std::string& name, const std::vector<float>& values, size_t nx, size_t ny,
+    const Options& options)
+{
+    if (options.sigma <= 0.0f) return;
+
+    const GaussianFilter filter(options.sigma);
+    std::vector<float> smoothed(values.size());
+
+    Record record;
+    record.field = name;
+    record.format = "float32";
+    record.mode = "gaussian r=" + std::to_string(filter.getRadius());
+    record.decider = "-";
+    // Reported per sample, the filter works on samples rather than cells
+    record.cells = nx * ny;
+    record.milliseconds = medianMilliseconds(options.repeat, [&]()
+    {
+        filter.apply(values.data(), smoothed.data(), nx, ny, options.threads);
+    });
+    printRecord(record, options.json);
+}
+
+// All benchmarks on one field given as floats, also stored as 8 and 16 bit integers and doubles
+void benchmarkField(const std::string& name, const std::vector<float>& values, size_t nx, size_t ny,
+    const Options& options)
+{
+    benchmarkFilter(name, values, nx, ny, options);
+
+    const auto range = std::minmax_element(values.begin(), values.end());
+    const float lo = *range.first;
+    const float hi = *range.second;
+
+    benchmarkExtraction(name, "float32", FieldView<float>(values.data(), nx, ny), options);
+
+    const auto u8 = convertField<std::uint8_t>(values, lo, hi);
+    benchmarkExtraction(name, "uint8", FieldView<std::uint8_t>(u8.data(), nx, ny), options);
+
+    const auto u16 = convertField<std::uint16_t>(values, lo, hi);
+    benchmarkExtraction(name, "uint16", FieldView<std::uint16_t>(u16.data(), nx, ny), options);
+
+    const auto f64 = convertField<double>(values, lo, hi);
+    benchmarkExtraction(name, "float64", FieldView<double>(f64.data(), nx, ny), options);
+}
+
+// Field held in memory, read tile by tile like a raw file by the streaming extraction
+class MemorySource : public TileSource
+{
+//Construction / Deconstruction
+public:
+    MemorySource(const std::vector<float>& values, size_t nx, size_t ny) : values_(values), nx_(nx), ny_(ny) {}
+
+//Methods
+public:
+    virtual size_t getWidth() const override { return nx_; }
+    virtual size_t getHeight() const override { return ny_; }
+    virtual void read(size_t x0, size_t y0, size_t w, size_t h, float* dst) const override
+    {
+        for (size_t y = 0; y < h; y++)
+        {
+            std::copy_n(values_.data() + (y0 + y) * nx_ + x0, w, dst + y * w);
+        }
+    }
+
+//Attributes
+private:
+    const std::vector<float>& values_;
+    size_t nx_;
+    size_t ny_;
+};
+
+// Counts the failed checks, every check prints one line
+struct Verifier
+{
+    size_t failures = 0;
+
+    void report(const std::string& field, const std::string& check, bool ok)
+    {
+        std::printf("%s,%s,%s\n", field.c_str(), check.c_str(), ok ? "ok" : "MISMATCH");
+        std::fflush(stdout);
+        if (!ok) failures++;
+    }
+};
+
+const char* deciderName(Decider decider)
+{
+    return decider == Decider::Midpoint ? "midpoint" : "asymptotic";
+}
+
+bool sameContours(const std::vector<ContourGeometry>& a, const std::vector<ContourGeometry>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t level = 0; level < a.size(); level++)
+    {
+        const auto& pa = a[level].polylines;
+        const auto& pb = b[level].polylines;
+        if (a[level].vertices != b[level].vertices || a[level].indices != b[level].indices ||
+            pa.size() != pb.size())
+        {
+            return false;
+        }
+        for (size_t p = 0; p < pa.size(); p++)
+        {
+            if (pa[p].begin != pb[p].begin || pa[p].end != pb[p].end || pa[p].closed != pb[p].closed)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool sameBands(const std::vector<BandGeometry>& a, const std::vector<BandGeometry>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t band = 0; band < a.size(); band++)
+    {
+        if (a[band].vertices != b[band].vertices || a[band].triangles != b[band].triangles) return false;
+    }
+    return true;
+}
+
+// Segments of every level as sorted pairs of end points, independent of the order
+// they were extracted in and of how the vertices are shared
+using SegmentSet = std::vector<std::tuple<float, float, float, float>>;
+
+void addSegment(const glm::vec2& p, const glm::vec2& q, SegmentSet& set)
+{
+    if (std::tie(q.x, q.y) < std::tie(p.x, p.y))
+    {
+        set.emplace_back(q.x, q.y, p.x, p.y);
+    }
+    else
+    {
+        set.emplace_back(p.x, p.y, q.x, q.y);
+    }
+}
+
+std::vector<SegmentSet> segmentSets(const std::vector<std::vector<glm::vec2>>& segments)
+{
+    std::vector<SegmentSet> sets(segments.size());
+    for (size_t level = 0; level < segments.size(); level++)
+    {
+        for (size_t i = 0; i + 1 < segments[level].size(); i += 2)
+        {
+            addSegment(segments[level][i], segments[level][i + 1], sets[level]);
+        }
+        std::sort(sets[level].begin(), sets[level].end());
+    }
+    return sets;
+}
+
+std::vector<SegmentSet> segmentSets(const std::vector<ContourGeometry>& contours)
+{
+    std::vector<SegmentSet> sets(contours.size());
+    for (size_t level = 0; level < contours.size(); level++)
+    {
+        const auto& vertices = contours[level].vertices;
+        const auto& indices = contours[level].indices;
+        for (const auto& polyline : contours[level].polylines)
+        {
+            for (size_t i = polyline.begin; i + 1 < polyline.end; i++)
+            {
+                addSegment(vertices[indices[i]], vertices[indices[i + 1]], sets[level]);
+            }
+            if (polyline.closed && polyline.size() > 1)
+            {
+                addSegment(vertices[indices[polyline.end - 1]], vertices[indices[polyline.begin]],
+                    sets[level]);
+            }
+        }
+        std::sort(sets[level].begin(), sets[level].end());
+    }
+    return sets;
+}
+
+// Polylines of every level as sequences of points, independent of the order they
+// were extracted in and of where a loop starts and which way a polyline runs
+using Point = std::pair<float, float>;
+using PolylineSet = std::vector<std::pair<bool, std::vector<Point>>>;
+
+std::vector<PolylineSet> polylineSets(const std::vector<ContourGeometry>& contours)
+{
+    std::vector<PolylineSet> sets(contours.size());
+    for (size_t level = 0; level < contours.size(); level++)
+    {
+        const auto& vertices = contours[level].vertices;
+        const auto& indices = contours[level].indices;
+        for (const auto& polyline : contours[level].polylines)
+        {
+            std::vector<Point> points;
+            for (size_t i = polyline.begin; i < polyline.end; i++)
+            {
+                points.emplace_back(vertices[indices[i]].x, vertices[indices[i]].y);
+            }
+            // Crossings at a sample equal to the isovalue can repeat a point, so
+            // every way of starting at the smallest one is tried
+            std::vector<Point> reversed(points.rbegin(), points.rend());
+            std::vector<Point> best = std::min(points, reversed);
+            if (polyline.closed)
+            {
+                const Point smallest =
+                    points.empty() ? Point() : *std::min_element(points.begin(), points.end());
+                for (auto* sequence : { &points, &reversed })
+                {
+                    for (size_t i = 0; i < sequence->size(); i++)
+                    {
+                        if ((*sequence)[i] != smallest) continue;
+                        std::vector<Point> rotated(sequence->begin() + i, sequence->end());
+                        rotated.insert(rotated.end(), sequence->begin(), sequence->begin() + i);
+                        best = std::min(best, rotated);
+                    }
+                }
+            }
+            sets[level].emplace_back(polyline.closed, std::move(best));
+        }
+        std::sort(sets[level].begin(), sets[level].end());
+    }
+    return sets;
+}
+
+// Every kernel gives the same result on one thread and on several, and contour
+// following gives the same polylines as the polyline extraction
+void verifyThreads(const std::string& name, const FieldView<float>& field, const Options& options,
+    Verifier& verifier)
+{
+    const std::vector<double> isoValues = fieldIsovalues(field, options.levels);
+    const double* begin = isoValues.data();
+    const double* end = isoValues.data() + isoValues.size();
+    const size_t threads = options.threads > 1 ? options.threads : 4;
+
+    MinMaxPyramid pyramid;
+    pyramid.build(field);
+    ContourSeeds seeds;
+    seeds.build(field);
+    for (const Decider decider : { Decider::Midpoint, Decider::Asymptotic })
+    {
+        const std::string suffix = std::string(" ") + deciderName(decider);
+
+        std::vector<std::vector<glm::vec2>> segments[2];
+        std::vector<ContourGeometry> polylines[2];
+        std::vector<ContourGeometry> following[2];
+        std::vector<BandGeometry> bands[2];
+        for (int run = 0; run < 2; run++)
+        {
+            const size_t numThreads = run == 0 ? 1 : threads;
+            extractSegments(field, begin, end, decider, &pyramid, segments[run], numThreads);
+            extractPolylines(field, begin, end, decider, polylines[run], &pyramid, numThreads);
+            followContours(field, begin, end, decider, seeds, following[run], numThreads);
+            extractIsobands(field, begin, end, decider, bands[run], numThreads);
+        }
+        verifier.report(name, "threads segments" + suffix, segments[0] == segments[1]);
+        verifier.report(name, "threads polylines" + suffix, sameContours(polylines[0], polylines[1]));
+        verifier.report(name, "threads following" + suffix, sameContours(following[0], following[1]));
+        verifier.report(name, "threads bands" + suffix, sameBands(bands[0], bands[1]));
+        verifier.report(name, "following polylines" + suffix,
+            polylineSets(following[0]) == polylineSets(polylines[0]));
+    }
+}
+
+// Extract the pieces of the field, change a rectangle of it and extract again only
+// the pieces it touches, like temporal coherence mode does. The joined pieces have
+// to be the same as a full extraction of the changed field.
+void verifyPieces(const std::string& name, const std::vector<float>& values, size_t nx, size_t ny,
+    const Options& options, Verifier& verifier)
+{
+    std::vector<float> changedValues(values);
+    const size_t x0 = nx / 3;
+    const size_t y0 = ny / 2;
+    for (size_t y = y0; y < std::min(ny, y0 + ny / 7 + 1); y++)
+    {
+        for (size_t x = x0; x < std::min(nx, x0 + nx / 5 + 1); x++)
+        {
+            changedValues[y * nx + x] += 0.1f * std::sin(0.7f * x + 0.3f * y);
+        }
+    }
+    const FieldView<float> field(values.data(), nx, ny);
+    const FieldView<float> changedField(changedValues.data(), nx, ny);
+
+    const std::vector<double> isoValues = fieldIsovalues(field, options.levels);
+    const double* begin = isoValues.data();
+    const double* end = isoValues.data() + isoValues.size();
+    const size_t numLevels = isoValues.size();
+
+    for (const Decider decider : { Decider::Midpoint, Decider::Asymptotic })
+    {
+        for (const Extraction extraction : { Extraction::Segments, Extraction::Polylines })
+        {
+            const bool segments = extraction == Extraction::Segments;
+            MinMaxPyramid pyramid;
+            pyramid.build(field);
+            std::vector<ContourPieces> pieces(numLevels);
+            std::vector<ContourPieces*> piecePointers;
+            for (auto& levelPieces : pieces)
+            {
+                piecePointers.push_back(&levelPieces);
+            }
+            std::vector<std::uint8_t> dirty(numContourPieces(extraction, nx - 1, ny - 1), 1);
+            auto extractPieces = [&](const FieldView<float>& source)
+            {
+                if (segments)
+                {
+                    extractSegmentPieces(source, begin, end, decider, pyramid, dirty, piecePointers.data(),
+                        options.threads);
+                }
+                else
+                {
+                    extractPolylinePieces(source, begin, end, decider, pyramid, dirty, piecePointers.data(),
+                        options.threads);
+                }
+            };
+            extractPieces(field);
+
+            std::vector<float> previous(values);
+            std::vector<Region> changed;
+            diffField(changedField, previous, changed, options.threads);
+            std::fill(dirty.begin(), dirty.end(), 0);
+            for (const auto& region : changed)
+            {
+                const Region cells = cellsTouching(region, nx, ny);
+                pyramid.update(changedField, cells.x0, cells.y0, cells.x1, cells.y1);
+                markContourPieces(extraction, cells, dirty);
+            }
+            extractPieces(changedField);
+
+            MinMaxPyramid fullPyramid;
+            fullPyramid.build(changedField);
+            bool same = true;
+            if (segments)
+            {
+                std::vector<std::vector<glm::vec2>> full;
+                extractSegments(changedField, begin, end, decider, &fullPyramid, full, options.threads);
+                std::vector<glm::vec2> joined;
+                for (size_t level = 0; level < numLevels; level++)
+                {
+                    joinSegmentPieces(pieces[level], joined);
+                    same = same && joined == full[level];
+                }
+            }
+            else
+            {
+                std::vector<ContourGeometry> full;
+                extractPolylines(changedField, begin, end, decider, full, &fullPyramid, options.threads);
+                std::vector<ContourGeometry> joined(numLevels);
+                for (size_t level = 0; level < numLevels; level++)
+                {
+                    joinPolylinePieces(pieces[level], nx - 1, joined[level]);
+                }
+                same = sameContours(joined, full);
+            }
+            verifier.report(name, std::string("pieces ") + (segments ? "segments " : "polylines ") +
+                deciderName(decider), same);
+        }
+    }
+}
+
+// Streaming the field in tiles, with and without the filter, gives the same
+// segments as extracting the whole field in memory
+void verifyStreaming(const std::string& name, const std::vector<float>& values, size_t nx, size_t ny,
+    const Options& options, Verifier& verifier)
+{
+    const std::vector<double> isoValues = fieldIsovalues(FieldView<float>(values.data(), nx, ny),
+        options.levels);
+    const double* begin = isoValues.data();
+    const double* end = isoValues.data() + isoValues.size();
+
+    for (const bool filtered : { false, true })
+    {
+        if (filtered && options.sigma <= 0.0f) continue;
+
+        std::vector<float> smoothed;
+        if (filtered)
+        {
+            const GaussianFilter filter(options.sigma);
+            smoothed.resize(values.size());
+            filter.apply(values.data(), smoothed.data(), nx, ny, options.threads);
+        }
+        const FieldView<float> field(filtered ? smoothed.data() : values.data(), nx, ny);
+
+        StreamingSettings settings;
+        // Several tiles per side, so that the seams are crossed
+        settings.tileSize = std::max<size_t>(16, std::min(nx, ny) / 3);
+        settings.sigma = filtered ? options.sigma : 0.0f;
+        settings.numThreads = options.threads;
+        for (const Decider decider : { Decider::Midpoint, Decider::Asymptotic })
+        {
+            settings.decider = decider;
+            const std::string suffix = std::string(filtered ? " filtered " : " ") + deciderName(decider);
+
+            std::vector<std::vector<glm::vec2>> streamedSegments;
+            std::vector<std::vector<glm::vec2>> segments;
+            MemorySource segmentSource(values, nx, ny);
+            streamSegments(segmentSource, begin, end, settings, streamedSegments);
+            extractSegments(field, begin, end, decider, nullptr, segments, options.threads);
+            verifier.report(name, "streaming segments" + suffix,
+                segmentSets(streamedSegments) == segmentSets(segments));
+
+            std::vector<ContourGeometry> streamedPolylines;
+            std::vector<ContourGeometry> polylines;
+            MemorySource polylineSource(values, nx, ny);
+            streamPolylines(polylineSource, begin, end, settings, streamedPolylines);
+            extractPolylines(field, begin, end, decider, polylines, nullptr, options.threads);
+            verifier.report(name, "streaming polylines" + suffix,
+                segmentSets(streamedPolylines) == segmentSets(polylines));
+        }
+    }
+}
+
+// The compact working copy of field gives the same contours and bands as field itself
+template <typename T>
+void verifyWorkingCopy(const std::string& name, const std::string& format, const FieldView<T>& field,
+    const Options& options, Verifier& verifier)
+{
+    const std::vector<double> isoValues = fieldIsovalues(field, options.levels);
+    const double* begin = isoValues.data();
+    const double* end = isoValues.data() + isoValues.size();
+
+    WorkingField working;
+    working.build(field);
+    for (const Decider decider : { Decider::Midpoint, Decider::Asymptotic })
+    {
+        // The extraction the processor runs on one slice, with a pyramid of the field it reads
+        auto extract = [&](const auto& source, std::vector<std::vector<glm::vec2>>& segments,
+            std::vector<ContourGeometry>& polylines, std::vector<BandGeometry>& bands)
+        {
+            MinMaxPyramid pyramid;
+            pyramid.build(source);
+            extractSegments(source, begin, end, decider, &pyramid, segments, options.threads);
+            extractPolylines(source, begin, end, decider, polylines, &pyramid, options.threads);
+            extractIsobands(source, begin, end, decider, bands, options.threads);
+        };
+        std::vector<std::vector<glm::vec2>> segments[2];
+        std::vector<ContourGeometry> polylines[2];
+        std::vector<BandGeometry> bands[2];
+        extract(field, segments[0], polylines[0], bands[0]);
+        const bool copied = working.dispatch([&](const auto& copy)
+        {
+            extract(copy, segments[1], polylines[1], bands[1]);
+        });
+        verifier.report(name, "working copy " + format + " " + deciderName(decider), copied &&
+            segments[0] == segments[1] && sameContours(polylines[0], polylines[1]) && sameBands(bands[0], bands[1]));
+    }
+}
+
+// All checks on one field given as floats. The working copy is checked for the
+// field stored as doubles and for integer samples stored as floats.
+void verifyField(const std::string& name, const std::vector<float>& values, size_t nx, size_t ny,
+    const Options& options, Verifier& verifier)
+{
+    verifyThreads(name, FieldView<float>(values.data(), nx, ny), options, verifier);
+    verifyPieces(name, values, nx, ny, options, verifier);
+    verifyStreaming(name, values, nx, ny, options, verifier);
+
+    const auto range = std::minmax_element(values.begin(), values.end());
+    const float lo = *range.first;
+    const float hi = *range.second;
+
+    const auto f64 = convertField<double>(values, lo, hi);
+    verifyWorkingCopy(name, "float64", FieldView<double>(f64.data(), nx, ny), options, verifier);
+
+    const auto u16 = convertField<std::uint16_t>(values, lo, hi);
+    const std::vector<float> u16Values(u16.begin(), u16.end());
+    verifyWorkingCopy(name, "uint16 as float32", FieldView<float>(u16Values.data(), nx, ny), options, verifier);
+
+    const auto i16 = convertField<std::int16_t>(values, lo, hi);
+    const std::vector<float> i16Values(i16.begin(), i16.end());
+    verifyWorkingCopy(name, "int16 as float32", FieldView<float>(i16Values.data(), nx, ny), options, verifier);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (options.verify)
+    {
+        Verifier verifier;
+        std::printf("field,check,result\n");
+        verifyField("smooth", makeField(Synthetic::Smooth, options.nx, options.ny), options.nx, options.ny, options,
+            verifier);
+        verifyField("noise", makeField(Synthetic::Noise, options.nx, options.ny), options.nx, options.ny, options,
+            verifier);
+        verifyField("checker", makeField(Synthetic::Checker, options.nx, options.ny), options.nx, options.ny, options,
+            verifier);
+        if (verifier.failures > 0)
+        {
+            std::fprintf(stderr, "%zu checks failed\n", verifier.failures);
+            return 2;
+        }
+        return 0;
+    }
+
+    if (!options.json)
+    {
+        std::printf("field,format,mode,decider,cells,ms,ns_per_cell,cells_per_s,active_ratio,vertices\n");
+    }
+
+    benchmarkField("smooth", makeField(Synthetic::Smooth, options.nx, options.ny), options.nx, options.ny, options);
+    benchmarkField("noise", makeField(Synthetic::Noise, options.nx, options.ny), options.nx, options.ny, options);
+    benchmarkField("checker", makeField(Synthetic::Checker, options.nx, options.ny), options.nx, options.ny, options);
+
+    if (!options.rawFile.empty())
+    {
+        try
+        {
+            RawFieldSource source(options.rawFile, options.rawType, options.rawNx, options.rawNy, options.rawOffset);
+            std::vector<float> values(options.rawNx * options.rawNy);
+            source.read(0, 0, options.rawNx, options.rawNy, values.data());
+            benchmarkField(options.rawFile, values, options.rawNx, options.rawNy, options);
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "%s\n", e.what());
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/scalarfield.h>
+#include <labmarchingsquares/simd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+// Samples [x0, x0 + count) of row j as floats. Rows of float fields are used in
+// place, other types are converted into buffer, which has to hold count values.
+template <typename T>
+const float* rowSamples(const FieldView<T>& field, size_t j, size_t x0, size_t count, float* buffer)
+{
+    const T* row = field.row(j) + x0;
+    for (size_t i = 0; i < count; i++)
+    {
+        buffer[i] = static_cast<float>(row[i]);
+    }
+    return buffer;
+}
+
+inline const float* rowSamples(const FieldView<float>& field, size_t j, size_t x0, size_t, float*)
+{
+    return field.row(j) + x0;
+}
+
+/** Classification of a row of cells before any crossing is interpolated.
+
+    The corner samples of the row are read (and converted to float) once, then
+    the value range of every cell is computed four cells at a time and compared
+    against the range of all isovalues. Only the cells that pass, the
+    candidates, have to be looked at by the kernels. The test is conservative,
+    a candidate still has to be checked against the isovalues themselves
+    (see firstIsovalueAbove), but every cell that straddles an isovalue is a
+    candidate.
+
+    One classifier holds the buffers for one thread.
+*/
+class RowClassifier
+{
+//Methods
+public:
+    // Prepare for rows of up to maxCells cells and the ascending isovalues [begin, end)
+    void reset(size_t maxCells, const double* begin, const double* end)
+    {
+        lowerBuffer_.resize(maxCells + 1);
+        upperBuffer_.resize(maxCells + 1);
+        lo_.resize(maxCells);
+        hi_.resize(maxCells);
+        candidates_.resize(maxCells);
+        if (begin == end)
+        {
+            // Nothing can be a candidate
+            cMin_ = std::numeric_limits<float>::infinity();
+            cMax_ = -std::numeric_limits<float>::infinity();
+            return;
+        }
+        // Round outwards so that the float comparisons never reject a cell the
+        // double comparisons would accept
+        cMin_ = static_cast<float>(begin[0]);
+        if (cMin_ > begin[0]) cMin_ = std::nextafter(cMin_, -std::numeric_limits<float>::infinity());
+        cMax_ = static_cast<float>(end[-1]);
+        if (cMax_ < end[-1]) cMax_ = std::nextafter(cMax_, std::numeric_limits<float>::infinity());
+    }
+
+    // Classify the cells [x0, x0 + n) of row iy of field, returns the number of candidates
+    template <typename T>
+    size_t classify(const FieldView<T>& field, size_t iy, size_t x0, size_t n)
+    {
+        return classify(rowSamples(field, iy, x0, n + 1, lowerBuffer_.data()),
+            rowSamples(field, iy + 1, x0, n + 1, upperBuffer_.data()), n);
+    }
+
+    // Classify the n cells with the corners lower[0, n] at iy and upper[0, n] at iy + 1,
+    // returns the number of candidates
+    size_t classify(const float* lower, const float* upper, size_t n)
+    {
+        lower_ = lower;
+        upper_ = upper;
+        float* lo = lo_.data();
+        float* hi = hi_.data();
+        std::uint32_t* candidates = candidates_.data();
+        size_t count = 0;
+
+        size_t i = 0;
+#ifdef LABMARCHINGSQUARES_SSE
+        const __m128 cMin = _mm_set1_ps(cMin_);
+        const __m128 cMax = _mm_set1_ps(cMax_);
+        for (; i + 4 <= n; i += 4)
+        {
+            const __m128 f00 = _mm_loadu_ps(lower + i);
+            const __m128 f10 = _mm_loadu_ps(lower + i + 1);
+            const __m128 f01 = _mm_loadu_ps(upper + i);
+            const __m128 f11 = _mm_loadu_ps(upper + i + 1);
+            const __m128 fmin = _mm_min_ps(_mm_min_ps(f00, f10), _mm_min_ps(f01, f11));
+            const __m128 fmax = _mm_max_ps(_mm_max_ps(f00, f10), _mm_max_ps(f01, f11));
+            _mm_storeu_ps(lo + i, fmin);
+            _mm_storeu_ps(hi + i, fmax);
+
+            const int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(fmax, cMin), _mm_cmplt_ps(fmin, cMax)));
+            // Append without branches, the slot after the last candidate is overwritten
+            for (int k = 0; k < 4; k++)
+            {
+                candidates[count] = static_cast<std::uint32_t>(i + k);
+                count += (mask >> k) & 1;
+            }
+        }
+#endif
+        for (; i < n; i++)
+        {
+            lo[i] = std::min({ lower[i], lower[i + 1], upper[i], upper[i + 1] });
+            hi[i] = std::max({ lower[i], lower[i + 1], upper[i], upper[i + 1] });
+            if (hi[i] > cMin_ && lo[i] < cMax_)
+            {
+                candidates[count++] = static_cast<std::uint32_t>(i);
+            }
+        }
+        return count;
+    }
+
+    // Index of the k-th candidate of the last classified row, relative to its first cell
+    size_t candidate(size_t k) const { return candidates_[k]; }
+
+    // Corner values and value range of cell i of the last classified row
+    float f00(size_t i) const { return lower_[i]; }
+    float f01(size_t i) const { return upper_[i]; }
+    float f11(size_t i) const { return upper_[i + 1]; }
+    float f10(size_t i) const { return lower_[i + 1]; }
+    float lo(size_t i) const { return lo_[i]; }
+    float hi(size_t i) const { return hi_[i]; }
+
+//Attributes
+private:
+    float cMin_ = 0.0f;
+    float cMax_ = 0.0f;
+    const float* lower_ = nullptr;
+    const float* upper_ = nullptr;
+    // Converted rows of fields that are not stored as float
+    std::vector<float> lowerBuffer_;
+    std::vector<float> upperBuffer_;
+    std::vector<float> lo_;
+    std::vector<float> hi_;
+    std::vector<std::uint32_t> candidates_;
+};
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,399 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+// Headless batch contouring of all raw files in a directory. It only depends on
+// the processor-independent sources of the module (contouringpipeline, contourio,
+// polylinesimplification, rawfield, streamingextraction and what they include) and glm.
+//
+// Usage:
+//   contourbatch --input DIR --output DIR --size NX NY --type TYPE [--header BYTES]
+//                [--suffix EXT] [--levels K | --isovalues V1,V2,...] [--sigma S]
+//                [--decider midpoint|asymptotic] [--mode segments|polylines|following]
+//                [--simplify none|douglas-peucker|visvalingam] [--tolerance T]
+//                [--format binary|text] [--jobs J] [--threads T] [--tile N]
+//
+// TYPE is one of int8, uint8, int16, uint16, int32, uint32, float32, float64.
+// Every file NAME.EXT in DIR (EXT defaults to .raw) is written to NAME.msqc
+// (binary) or NAME.txt (text) in the output directory, see contourio.h for the
+// formats. --levels K (default 8) takes K evenly spaced isovalues inside the
+// value range of every file like the processor does, --isovalues fixed ones.
+//
+// J files (default one per core) are contoured at the same time, with T threads
+// (default 1) each for the filter and the extraction. Segments and polylines are
+// streamed from the memory-mapped file tile by tile, so the memory of a job is
+// bounded by the tile size and its contours. Contour following reads the whole
+// field. Simplification needs shared vertices, segments are then extracted as
+// polylines like in the processor.
+//
+// One line is printed per file and a summary at the end. The exit code is 1 if
+// any file failed.
+
+#include <labmarchingsquares/contourio.h>
+#include <labmarchingsquares/contouringpipeline.h>
+#include <labmarchingsquares/parallelfor.h>
+#include <labmarchingsquares/polylinesimplification.h>
+#include <labmarchingsquares/rawfield.h>
+#include <labmarchingsquares/streamingextraction.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+using namespace inviwo;
+using namespace inviwo::contouring;
+
+namespace
+{
+
+struct Options
+{
+    std::string input;
+    std::string output;
+    std::string suffix = ".raw";
+    size_t nx = 0;
+    size_t ny = 0;
+    RawType type = RawType::Float32;
+    bool hasType = false;
+    size_t offset = 0;
+
+    size_t levels = 8;
+    // Ascending and unique, empty if the isovalues come from levels
+    std::vector<double> isoValues;
+    float sigma = 0.0f;
+    Decider decider = Decider::Midpoint;
+    Extraction extraction = Extraction::Polylines;
+    Simplification simplification = Simplification::None;
+    float tolerance = 0.001f;
+    ContourFormat format = ContourFormat::Binary;
+
+    size_t jobs = 0;
+    size_t threads = 1;
+    size_t tileSize = 512;
+};
+
+// What became of one file
+struct FileResult
+{
+    std::string error;
+    size_t levels = 0;
+    size_t vertices = 0;
+    double milliseconds = 0.0;
+};
+
+// Index of name in names, or -1
+template <size_t N>
+int findName(const char* (&names)[N], const std::string& name)
+{
+    for (size_t i = 0; i < N; i++)
+    {
+        if (name == names[i]) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+bool parseIsovalues(const std::string& list, std::vector<double>& isoValues)
+{
+    const char* s = list.c_str();
+    while (*s)
+    {
+        char* next = nullptr;
+        isoValues.push_back(std::strtod(s, &next));
+        if (next == s || (*next && *next != ',')) return false;
+        s = *next ? next + 1 : next;
+    }
+    // The kernels expect ascending isovalues
+    std::sort(isoValues.begin(), isoValues.end());
+    isoValues.erase(std::unique(isoValues.begin(), isoValues.end()), isoValues.end());
+    return !isoValues.empty();
+}
+
+void printUsage()
+{
+    std::fprintf(stderr,
+        "usage: contourbatch --input DIR --output DIR --size NX NY --type TYPE [--header BYTES]\n"
+        "                    [--suffix EXT] [--levels K | --isovalues V1,V2,...] [--sigma S]\n"
+        "                    [--decider midpoint|asymptotic] [--mode segments|polylines|following]\n"
+        "                    [--simplify none|douglas-peucker|visvalingam] [--tolerance T]\n"
+        "                    [--format binary|text] [--jobs J] [--threads T] [--tile N]\n");
+}
+
+bool parseOptions(int argc, char** argv, Options& options)
+{
+    static const char* deciderNames[] = { "midpoint", "asymptotic" };
+    static const char* modeNames[] = { "segments", "polylines", "following" };
+    static const char* simplificationNames[] = { "none", "douglas-peucker", "visvalingam" };
+    static const char* formatNames[] = { "binary", "text" };
+
+    auto number = [&](int i) { return static_cast<size_t>(std::strtoull(argv[i], nullptr, 10)); };
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const int left = argc - i - 1;
+        int index = 0;
+        if (arg == "--input" && left >= 1) options.input = argv[++i];
+        else if (arg == "--output" && left >= 1) options.output = argv[++i];
+        else if (arg == "--suffix" && left >= 1) options.suffix = argv[++i];
+        else if (arg == "--size" && left >= 2)
+        {
+            options.nx = number(++i);
+            options.ny = number(++i);
+        }
+        else if (arg == "--type" && left >= 1)
+        {
+            if (!parseRawType(argv[++i], options.type)) return false;
+            options.hasType = true;
+        }
+        else if (arg == "--header" && left >= 1) options.offset = number(++i);
+        else if (arg == "--levels" && left >= 1) options.levels = number(++i);
+        else if (arg == "--isovalues" && left >= 1)
+        {
+            if (!parseIsovalues(argv[++i], options.isoValues)) return false;
+        }
+        else if (arg == "--sigma" && left >= 1) options.sigma = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--decider" && left >= 1)
+        {
+            if ((index = findName(deciderNames, argv[++i])) < 0) return false;
+            options.decider = static_cast<Decider>(index);
+        }
+        else if (arg == "--mode" && left >= 1)
+        {
+            if ((index = findName(modeNames, argv[++i])) < 0) return false;
+            options.extraction = static_cast<Extraction>(index);
+        }
+        else if (arg == "--simplify" && left >= 1)
+        {
+            if ((index = findName(simplificationNames, argv[++i])) < 0) return false;
+            options.simplification = static_cast<Simplification>(index);
+        }
+        else if (arg == "--tolerance" && left >= 1) options.tolerance = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "--format" && left >= 1)
+        {
+            if ((index = findName(formatNames, argv[++i])) < 0) return false;
+            options.format = static_cast<ContourFormat>(index);
+        }
+        else if (arg == "--jobs" && left >= 1) options.jobs = number(++i);
+        else if (arg == "--threads" && left >= 1) options.threads = number(++i);
+        else if (arg == "--tile" && left >= 1) options.tileSize = std::max<size_t>(2, number(++i));
+        else
+        {
+            return false;
+        }
+    }
+
+    if (options.simplification != Simplification::None && options.extraction == Extraction::Segments)
+    {
+        options.extraction = Extraction::Polylines;
+    }
+    return !options.input.empty() && !options.output.empty() && options.nx >= 2 && options.ny >= 2 &&
+        options.hasType && (options.levels > 0 || !options.isoValues.empty());
+}
+
+// Names of the files in dir that end in suffix, sorted
+std::vector<std::string> listFiles(const std::string& dir, const std::string& suffix)
+{
+    std::vector<std::string> names;
+    auto add = [&](const std::string& name)
+    {
+        if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            names.push_back(name);
+        }
+    };
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &entry);
+    if (find == INVALID_HANDLE_VALUE) throw std::runtime_error("Cannot list " + dir);
+    do
+    {
+        if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) add(entry.cFileName);
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) throw std::runtime_error("Cannot list " + dir + ": " + std::strerror(errno));
+    while (const dirent* entry = readdir(handle))
+    {
+        add(entry->d_name);
+    }
+    closedir(handle);
+#endif
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+// Contours of all isovalues of one file, in segments or in contours depending on the mode
+void extractFile(RawFieldSource& source, const std::vector<double>& isoValues, const Options& options,
+    const GaussianFilter& filter, ContourLevels& levels)
+{
+    const double* begin = isoValues.data();
+    const double* end = isoValues.data() + isoValues.size();
+    const size_t nx = source.getWidth();
+    const size_t ny = source.getHeight();
+
+    if (options.extraction != Extraction::Following)
+    {
+        StreamingSettings settings;
+        settings.tileSize = options.tileSize;
+        settings.sigma = options.sigma;
+        settings.decider = options.decider;
+        settings.numThreads = options.threads;
+        if (options.extraction == Extraction::Segments)
+        {
+            streamSegments(source, begin, end, settings, levels.segments);
+        }
+        else
+        {
+            streamPolylines(source, begin, end, settings, levels.contours);
+        }
+        return;
+    }
+
+    // The tracer jumps around the field, so it is read as a whole
+    std::vector<float> values(nx * ny);
+    source.read(0, 0, nx, ny, values.data());
+    std::vector<float> smoothed;
+    if (options.sigma > 0.0f)
+    {
+        smoothField(FieldView<float>(values.data(), nx, ny), filter, smoothed, options.threads);
+        values.swap(smoothed);
+    }
+
+    ContouringSettings settings;
+    settings.decider = options.decider;
+    settings.extraction = options.extraction;
+    settings.numThreads = options.threads;
+    FieldAcceleration acceleration;
+    ContouringStats stats;
+    extractContours(FieldView<float>(values.data(), nx, ny), begin, end, settings, acceleration, levels, stats);
+}
+
+FileResult processFile(const std::string& inPath, const std::string& outPath, const Options& options,
+    const GaussianFilter& filter)
+{
+    FileResult result;
+    const auto start = std::chrono::steady_clock::now();
+    try
+    {
+        RawFieldSource source(inPath, options.type, options.nx, options.ny, options.offset);
+
+        std::vector<double> isoValues = options.isoValues;
+        if (isoValues.empty())
+        {
+            const glm::vec2 range = findValueRange(source);
+            isoValues = evenlySpacedIsovalues(range.x, range.y, options.levels);
+        }
+
+        ContourLevels levels;
+        extractFile(source, isoValues, options, filter, levels);
+
+        std::ofstream file(outPath, options.format == ContourFormat::Binary
+            ? std::ios::out | std::ios::binary : std::ios::out);
+        if (!file) throw std::runtime_error("Cannot open " + outPath);
+        ContourWriter writer(file, options.format, options.nx, options.ny, isoValues.size());
+        for (size_t level = 0; level < isoValues.size(); level++)
+        {
+            if (options.extraction == Extraction::Segments)
+            {
+                writer.writeLevel(isoValues[level], levels.segments[level]);
+                result.vertices += levels.segments[level].size();
+            }
+            else
+            {
+                auto& contour = levels.contours[level];
+                simplifyContour(contour, options.simplification, options.tolerance, options.threads);
+                writer.writeLevel(isoValues[level], contour);
+                result.vertices += contour.vertices.size();
+            }
+        }
+        file.close();
+        if (!file) throw std::runtime_error("Cannot write " + outPath);
+        result.levels = isoValues.size();
+    }
+    catch (const std::exception& e)
+    {
+        result.error = e.what();
+    }
+    result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<std::string> names;
+    try
+    {
+        names = listFiles(options.input, options.suffix);
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    // The kernel is shared by all jobs, applying it does not change it
+    const GaussianFilter filter(options.sigma > 0.0f ? options.sigma : 1.0f);
+    const char* extension = options.format == ContourFormat::Binary ? ".msqc" : ".txt";
+
+    const auto start = std::chrono::steady_clock::now();
+    std::mutex printMutex;
+    std::vector<FileResult> results(names.size());
+    parallelForEach(names.size(), options.jobs, [&](size_t f, size_t)
+    {
+        const std::string& name = names[f];
+        const std::string stem = name.substr(0, name.size() - options.suffix.size());
+        FileResult& result = results[f];
+        result = processFile(options.input + "/" + name, options.output + "/" + stem + extension, options, filter);
+
+        std::lock_guard<std::mutex> lock(printMutex);
+        if (result.error.empty())
+        {
+            std::printf("%s: %zu levels, %zu vertices, %.1f ms\n", name.c_str(), result.levels, result.vertices,
+                result.milliseconds);
+        }
+        else
+        {
+            std::fprintf(stderr, "%s: %s\n", name.c_str(), result.error.c_str());
+        }
+        std::fflush(stdout);
+    });
+
+    const size_t failed = static_cast<size_t>(std::count_if(results.begin(), results.end(),
+        [](const FileResult& result) { return !result.error.empty(); }));
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::printf("%zu files, %zu failed, %.1f ms\n", names.size(), failed, milliseconds);
+
+    return failed > 0 ? 1 : 0;
+}
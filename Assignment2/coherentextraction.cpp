@@ -0,0 +1,72 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/coherentextraction.h>
+
+#include <algorithm>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+size_t numContourPieces(Extraction extraction, size_t cellsX, size_t cellsY)
+{
+    const size_t cells = extraction == Extraction::Segments ? cellsX : cellsY;
+    return (cells + MinMaxPyramid::blockSize - 1) / MinMaxPyramid::blockSize;
+}
+
+void markContourPieces(Extraction extraction, const Region& cells, std::vector<std::uint8_t>& dirty)
+{
+    const size_t first = extraction == Extraction::Segments ? cells.x0 : cells.y0;
+    const size_t end = extraction == Extraction::Segments ? cells.x1 : cells.y1;
+    if (first >= end || dirty.empty()) return;
+
+    const size_t last = std::min((end - 1) / MinMaxPyramid::blockSize, dirty.size() - 1);
+    for (size_t piece = first / MinMaxPyramid::blockSize; piece <= last; piece++)
+    {
+        dirty[piece] = 1;
+    }
+}
+
+Region cellsTouching(const Region& samples, size_t nx, size_t ny)
+{
+    // Cell (ix, iy) has the corner samples ix, ix + 1 and iy, iy + 1
+    return { samples.x0 > 0 ? samples.x0 - 1 : 0, samples.y0 > 0 ? samples.y0 - 1 : 0,
+        std::min(samples.x1, nx - 1), std::min(samples.y1, ny - 1) };
+}
+
+Region dilateRegion(const Region& samples, size_t radius, size_t nx, size_t ny)
+{
+    return { samples.x0 > radius ? samples.x0 - radius : 0, samples.y0 > radius ? samples.y0 - radius : 0,
+        std::min(samples.x1 + radius, nx), std::min(samples.y1 + radius, ny) };
+}
+
+void joinSegmentPieces(const ContourPieces& pieces, std::vector<glm::vec2>& segments)
+{
+    size_t total = 0;
+    for (const auto& column : pieces.columns)
+    {
+        total += column.size();
+    }
+    segments.clear();
+    segments.reserve(total);
+    // Columns in x order are the scan order of extractSegments
+    for (const auto& column : pieces.columns)
+    {
+        segments.insert(segments.end(), column.begin(), column.end());
+    }
+}
+
+void joinPolylinePieces(const ContourPieces& pieces, size_t cellsX, ContourGeometry& out)
+{
+    // Empty bands of inactive rows have no seams, so they join nothing
+    mergePolylineBands(pieces.bands.data(), pieces.bands.size(), cellsX, out);
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,326 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/labmarchingsquaresmoduledefine.h>
+#include <labmarchingsquares/contourgeometry.h>
+#include <labmarchingsquares/contouringpipeline.h>
+#include <labmarchingsquares/marchingsquarescell.h>
+#include <labmarchingsquares/minmaxpyramid.h>
+#include <labmarchingsquares/parallelfor.h>
+#include <labmarchingsquares/polylineextraction.h>
+#include <labmarchingsquares/profiling.h>
+#include <labmarchingsquares/scalarfield.h>
+#include <labmarchingsquares/segmentextraction.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Temporal coherence for fields that change only in places from one frame to
+// the next. The contours of every isovalue are kept in pieces of one block
+// column (line segments) or one block row (polylines) of the pyramid. A new
+// frame is compared with the last one by diffField, and only the pieces that
+// hold changed cells are extracted again and joined with the others. The
+// joined contours are the same as those of extracting the whole frame.
+
+namespace inviwo
+{
+namespace contouring
+{
+
+// Samples or cells [x0, x1) x [y0, y1)
+struct Region
+{
+    size_t x0, y0, x1, y1;
+};
+
+// Contours of one isovalue in pieces that are extracted on their own, columns
+// for Extraction::Segments and bands for Extraction::Polylines
+struct ContourPieces
+{
+    std::vector<std::vector<glm::vec2>> columns;
+    std::vector<PolylineBand> bands;
+};
+
+// Number of pieces of a field of cellsX x cellsY cells, extraction is not Following
+IVW_MODULE_LABMARCHINGSQUARES_API size_t numContourPieces(Extraction extraction, size_t cellsX,
+    size_t cellsY);
+
+// Flag the pieces that hold any of the cells of region in dirty, which has one flag per piece
+IVW_MODULE_LABMARCHINGSQUARES_API void markContourPieces(Extraction extraction, const Region& cells,
+    std::vector<std::uint8_t>& dirty);
+
+// Cells of a field of nx x ny samples that have a corner sample in region
+IVW_MODULE_LABMARCHINGSQUARES_API Region cellsTouching(const Region& samples, size_t nx, size_t ny);
+
+// Samples within radius of region, clipped to a field of nx x ny samples
+IVW_MODULE_LABMARCHINGSQUARES_API Region dilateRegion(const Region& samples, size_t radius,
+    size_t nx, size_t ny);
+
+// Join the pieces of one isovalue, the result is the same as that of extractSegments
+IVW_MODULE_LABMARCHINGSQUARES_API void joinSegmentPieces(const ContourPieces& pieces,
+    std::vector<glm::vec2>& segments);
+
+// Join the pieces of one isovalue, the result is the same as that of extractPolylines
+IVW_MODULE_LABMARCHINGSQUARES_API void joinPolylinePieces(const ContourPieces& pieces, size_t cellsX,
+    ContourGeometry& out);
+
+/** Compare field with previous, the float samples of the last frame, in blocks of
+    MinMaxPyramid::blockSize samples per side. The samples of changed blocks are
+    written to previous, so it holds the new frame afterwards. Every run of
+    changed blocks within one block row is appended to changed as a region of
+    samples. Returns the number of changed blocks.
+
+    previous has to have the size of the field. The block rows are compared on
+    numThreads threads (0 uses one per core).
+*/
+template <typename T>
+size_t diffField(const FieldView<T>& field, std::vector<float>& previous, std::vector<Region>& changed,
+    size_t numThreads = 0)
+{
+    const size_t blockSize = MinMaxPyramid::blockSize;
+    const size_t blocksX = (field.nx + blockSize - 1) / blockSize;
+    const size_t blocksY = (field.ny + blockSize - 1) / blockSize;
+
+    std::vector<std::uint8_t> blockChanged(blocksX * blocksY, 0);
+    parallelFor(blocksY, resolveThreadCount(numThreads, blocksY), [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t by = begin; by < end; by++)
+        {
+            const size_t y0 = by * blockSize;
+            const size_t y1 = std::min(y0 + blockSize, field.ny);
+            for (size_t y = y0; y < y1; y++)
+            {
+                const T* row = field.row(y);
+                float* last = previous.data() + y * field.nx;
+                for (size_t x = 0; x < field.nx; x++)
+                {
+                    const float value = static_cast<float>(row[x]);
+                    if (value == last[x]) continue;
+                    last[x] = value;
+                    blockChanged[by * blocksX + x / blockSize] = 1;
+                }
+            }
+        }
+    });
+
+    size_t numChanged = 0;
+    for (size_t by = 0; by < blocksY; by++)
+    {
+        for (size_t bx = 0; bx < blocksX;)
+        {
+            if (!blockChanged[by * blocksX + bx])
+            {
+                bx++;
+                continue;
+            }
+            const size_t first = bx;
+            while (bx < blocksX && blockChanged[by * blocksX + bx]) bx++;
+            numChanged += bx - first;
+            changed.push_back({ first * blockSize, by * blockSize, std::min(bx * blockSize, field.nx),
+                std::min((by + 1) * blockSize, field.ny) });
+        }
+    }
+    return numChanged;
+}
+
+/** Extract the flagged block columns of the ascending isovalues [begin, end) into
+    pieces[level]->columns, with the active blocks of pyramid, which has to be
+    up to date for field. The other columns are left as they are.
+
+    The columns are scheduled over numThreads threads (0 uses one per core). If
+    counters is given, what the extraction did is added to it. If cancel is given,
+    it is checked before every column. Once it is set the remaining columns are
+    skipped and the pieces are incomplete.
+*/
+template <typename T>
+void extractSegmentPieces(const FieldView<T>& field, const double* begin, const double* end,
+    Decider decider, const MinMaxPyramid& pyramid, const std::vector<std::uint8_t>& dirty,
+    ContourPieces* const* pieces, size_t numThreads = 0, ExtractionCounters* counters = nullptr,
+    const std::atomic<bool>* cancel = nullptr)
+{
+    const size_t numLevels = end - begin;
+    if (field.nx < 2 || field.ny < 2 || numLevels == 0) return;
+
+    const size_t blockSize = MinMaxPyramid::blockSize;
+    const size_t numColumns = numContourPieces(Extraction::Segments, field.nx - 1, field.ny - 1);
+    for (size_t level = 0; level < numLevels; level++)
+    {
+        pieces[level]->columns.resize(numColumns);
+    }
+
+    // Active blocks of column c are [columnBlocks[c], columnBlocks[c + 1])
+    std::vector<MinMaxPyramid::Block> blocks;
+    pyramid.findActiveBlocks(begin, end, MinMaxPyramid::Order::ColumnMajor, blocks);
+    std::vector<size_t> columnBlocks(numColumns + 1, 0);
+    for (const auto& block : blocks)
+    {
+        columnBlocks[block.x0 / blockSize + 1]++;
+    }
+    for (size_t c = 0; c < numColumns; c++)
+    {
+        columnBlocks[c + 1] += columnBlocks[c];
+    }
+
+    std::vector<size_t> columns;
+    for (size_t c = 0; c < numColumns; c++)
+    {
+        if (dirty[c]) columns.push_back(c);
+    }
+
+    struct Scratch
+    {
+        SegmentWorkspace workspace;
+        std::vector<std::vector<glm::vec2>> points;
+        ExtractionCounters counters;
+    };
+    const size_t threads = resolveThreadCount(numThreads, columns.size());
+    std::vector<Scratch> scratch(threads);
+    parallelForEach(columns.size(), threads, [&](size_t task, size_t thread)
+    {
+        if (isCancelled(cancel)) return;
+        const size_t c = columns[task];
+        Scratch& s = scratch[thread];
+        s.points.resize(numLevels);
+        // The column keeps its memory, it is only cleared
+        for (size_t level = 0; level < numLevels; level++)
+        {
+            std::swap(s.points[level], pieces[level]->columns[c]);
+            s.points[level].clear();
+        }
+        s.workspace.blocks.assign(blocks.begin() + columnBlocks[c], blocks.begin() + columnBlocks[c + 1]);
+        if (!s.workspace.blocks.empty())
+        {
+            detail::extractSegmentBlocks(field, begin, end, decider, s.points, 1, &s.counters,
+                s.workspace);
+        }
+        for (size_t level = 0; level < numLevels; level++)
+        {
+            std::swap(s.points[level], pieces[level]->columns[c]);
+        }
+    });
+
+    if (counters)
+    {
+        for (const auto& s : scratch)
+        {
+            *counters += s.counters;
+        }
+        counters->countBytes(vectorBytes(blocks) + vectorBytes(columnBlocks) + vectorBytes(columns));
+    }
+}
+
+/** Extract the flagged block rows of the ascending isovalues [begin, end) into
+    pieces[level]->bands, with the active blocks of pyramid, which has to be up
+    to date for field. A row without active blocks gets an empty band. The other
+    rows are left as they are.
+
+    The rows are scheduled over numThreads threads (0 uses one per core). If
+    counters is given, what the extraction did is added to it. If cancel is given,
+    it is checked before every row. Once it is set the remaining rows are skipped
+    and the pieces are incomplete.
+*/
+template <typename T>
+void extractPolylinePieces(const FieldView<T>& field, const double* begin, const double* end,
+    Decider decider, const MinMaxPyramid& pyramid, const std::vector<std::uint8_t>& dirty,
+    ContourPieces* const* pieces, size_t numThreads = 0, ExtractionCounters* counters = nullptr,
+    const std::atomic<bool>* cancel = nullptr)
+{
+    const size_t numLevels = end - begin;
+    if (field.nx < 2 || field.ny < 2 || numLevels == 0) return;
+
+    const size_t blockSize = MinMaxPyramid::blockSize;
+    const size_t cellsX = field.nx - 1;
+    const size_t cellsY = field.ny - 1;
+    const size_t numRows = numContourPieces(Extraction::Polylines, cellsX, cellsY);
+    for (size_t level = 0; level < numLevels; level++)
+    {
+        pieces[level]->bands.resize(numRows);
+    }
+
+    // Active blocks of row r are [rowBlocks[r], rowBlocks[r + 1])
+    std::vector<MinMaxPyramid::Block> blocks;
+    pyramid.findActiveBlocks(begin, end, MinMaxPyramid::Order::RowMajor, blocks);
+    std::vector<size_t> rowBlocks(numRows + 1, 0);
+    for (const auto& block : blocks)
+    {
+        rowBlocks[block.y0 / blockSize + 1]++;
+    }
+    for (size_t r = 0; r < numRows; r++)
+    {
+        rowBlocks[r + 1] += rowBlocks[r];
+    }
+
+    std::vector<size_t> rows;
+    for (size_t r = 0; r < numRows; r++)
+    {
+        if (dirty[r]) rows.push_back(r);
+    }
+
+    struct Scratch
+    {
+        std::vector<detail::EdgeCache> caches;
+        RowClassifier classifier;
+        std::vector<PolylineBand> bands;
+        ExtractionCounters counters;
+    };
+    const size_t threads = resolveThreadCount(numThreads, rows.size());
+    std::vector<Scratch> scratch(threads);
+    for (auto& s : scratch)
+    {
+        s.classifier.reset(cellsX, begin, end);
+        s.bands.resize(numLevels);
+    }
+    parallelForEach(rows.size(), threads, [&](size_t task, size_t thread)
+    {
+        if (isCancelled(cancel)) return;
+        const size_t r = rows[task];
+        Scratch& s = scratch[thread];
+        for (size_t level = 0; level < numLevels; level++)
+        {
+            std::swap(s.bands[level], pieces[level]->bands[r]);
+        }
+        if (rowBlocks[r] < rowBlocks[r + 1])
+        {
+            detail::extractPolylineBand(field, begin, end, decider, blocks.data() + rowBlocks[r],
+                blocks.data() + rowBlocks[r + 1], s.caches, s.classifier, s.bands.data(), 1, s.counters);
+        }
+        else
+        {
+            for (auto& band : s.bands)
+            {
+                band.clear();
+                band.firstRow = r * blockSize;
+                band.endRow = std::min(band.firstRow + blockSize, cellsY);
+            }
+        }
+        for (size_t level = 0; level < numLevels; level++)
+        {
+            std::swap(s.bands[level], pieces[level]->bands[r]);
+        }
+    });
+
+    if (counters)
+    {
+        for (const auto& s : scratch)
+        {
+            *counters += s.counters;
+            for (const auto& cache : s.caches)
+            {
+                counters->countBytes(vectorBytes(cache.below) + vectorBytes(cache.above) +
+                    vectorBytes(cache.vertical));
+            }
+        }
+        counters->countBytes(vectorBytes(blocks) + vectorBytes(rowBlocks) + vectorBytes(rows));
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,44 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/contourfollowing.h>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+void ContourSeeds::clear()
+{
+    cellsX_ = 0;
+    cellsY_ = 0;
+    seeds_.clear();
+}
+
+size_t ContourSeeds::getByteSize() const
+{
+    return vectorBytes(seeds_);
+}
+
+void ContourSeeds::markPathToBorder(size_t i, size_t j, std::vector<std::uint8_t>& isSeed,
+    std::vector<std::uint8_t>& lineMarked) const
+{
+    // The cells in the rows below and above the line, from the column right of
+    // the sample (in case the isoline passes through the sample) to column 0.
+    // A marked cell of the line means the rest of it is marked as well.
+    for (size_t ix = i + 1; ix-- > 0;)
+    {
+        std::uint8_t& marked = lineMarked[j * cellsX_ + ix];
+        if (marked) break;
+        marked = 1;
+        isSeed[(j - 1) * cellsX_ + ix] = 1;
+        isSeed[j * cellsX_ + ix] = 1;
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo
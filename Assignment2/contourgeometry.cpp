@@ -0,0 +1,176 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/contourgeometry.h>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+size_t ContourGeometry::getNumberOfSegments() const
+{
+    size_t count = 0;
+    for (const auto& line : polylines)
+    {
+        if (line.size() < 2) continue;
+        count += line.closed ? line.size() : line.size() - 1;
+    }
+    return count;
+}
+
+void ContourGeometry::clear()
+{
+    vertices.clear();
+    indices.clear();
+    polylines.clear();
+}
+
+void stitchPolylines(std::vector<VertexLinks>& links, ContourGeometry& out)
+{
+    const std::uint32_t numVertices = static_cast<std::uint32_t>(links.size());
+    // First link of a visited vertex, no vertex has a neighbor with this index
+    const std::uint32_t visited = noVertex - 1;
+
+    out.indices.clear();
+    out.polylines.clear();
+    out.indices.resize(numVertices);
+    std::uint32_t* indices = out.indices.data();
+    size_t numIndices = 0;
+
+    // The first step takes the only link of an open start or the first one of a
+    // closed start, every further one the link of the vertex that does not lead
+    // back. The links of a vertex hold the previous vertex, so the other one is
+    // found without a branch on which slot it is in. A loop ends when it is back
+    // at start, an open polyline at a missing link.
+    auto walk = [&](std::uint32_t start, bool closed)
+    {
+        Polyline line;
+        line.begin = numIndices;
+        line.closed = closed;
+        indices[numIndices++] = start;
+        std::uint32_t prev = start;
+        // Of the links of an open start one is noVertex, with all bits set
+        std::uint32_t current = closed ? links[start][0] : links[start][0] & links[start][1];
+        links[start][0] = visited;
+        const std::uint32_t stop = closed ? start : noVertex;
+        while (current != stop && numIndices < numVertices)
+        {
+            indices[numIndices++] = current;
+            const VertexLinks slots = links[current];
+            links[current][0] = visited;
+            const std::uint32_t next = slots[0] ^ slots[1] ^ prev;
+            prev = current;
+            current = next;
+        }
+        line.end = numIndices;
+        out.polylines.push_back(line);
+    };
+
+    // Open polylines start and end at vertices with a single segment
+    for (std::uint32_t v = 0; v < numVertices; v++)
+    {
+        if (links[v][0] != visited && (links[v][0] == noVertex) != (links[v][1] == noVertex))
+        {
+            walk(v, false);
+        }
+    }
+    // Everything that is left lies on a closed loop
+    for (std::uint32_t v = 0; v < numVertices; v++)
+    {
+        if (links[v][0] != visited && links[v][0] != noVertex && links[v][1] != noVertex)
+        {
+            walk(v, true);
+        }
+    }
+    out.indices.resize(numIndices);
+}
+
+void PolylineBand::clear()
+{
+    vertices.clear();
+    links.clear();
+    bottomSeam.clear();
+    topSeam.clear();
+    firstRow = 0;
+    endRow = 0;
+}
+
+void mergePolylineBands(const PolylineBand* bands, size_t numBands, size_t cellsX,
+    ContourGeometry& out, PolylineMergeScratch* scratch)
+{
+    out.clear();
+
+    PolylineMergeScratch localScratch;
+    PolylineMergeScratch& s = scratch ? *scratch : localScratch;
+
+    size_t numVertices = 0;
+    for (size_t b = 0; b < numBands; b++)
+    {
+        numVertices += bands[b].vertices.size();
+    }
+    out.vertices.reserve(numVertices);
+    auto& links = s.links;
+    links.clear();
+    links.reserve(numVertices);
+
+    // Merged vertices on the top edges of the previous band's last row
+    auto& previousTop = s.previousTop;
+    previousTop.assign(cellsX, noVertex);
+    auto& remap = s.remap;
+
+    for (size_t b = 0; b < numBands; b++)
+    {
+        const PolylineBand& band = bands[b];
+        remap.assign(band.vertices.size(), noVertex);
+
+        if (b > 0 && bands[b - 1].endRow == band.firstRow)
+        {
+            for (const auto& seam : band.bottomSeam)
+            {
+                remap[seam[1]] = previousTop[seam[0]];
+            }
+        }
+        for (size_t v = 0; v < band.vertices.size(); v++)
+        {
+            if (remap[v] == noVertex)
+            {
+                remap[v] = static_cast<std::uint32_t>(out.vertices.size());
+                out.vertices.push_back(band.vertices[v]);
+                links.push_back({ { noVertex, noVertex } });
+            }
+        }
+        // A seam vertex has its link into the lower band in the first slot and the
+        // one into the upper band in the second, as if all rows were extracted at once
+        for (size_t v = 0; v < band.links.size(); v++)
+        {
+            auto& slots = links[remap[v]];
+            for (size_t k = 0; k < 2; k++)
+            {
+                const std::uint32_t neighbor = band.links[v][k];
+                if (neighbor != noVertex) slots[k] = remap[neighbor];
+            }
+        }
+
+        if (b > 0)
+        {
+            for (const auto& seam : bands[b - 1].topSeam)
+            {
+                previousTop[seam[0]] = noVertex;
+            }
+        }
+        for (const auto& seam : band.topSeam)
+        {
+            previousTop[seam[0]] = remap[seam[1]];
+        }
+    }
+
+    stitchPolylines(links, out);
+}
+
+} // namespace contouring
+} // namespace inviwo
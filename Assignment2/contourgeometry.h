@@ -0,0 +1,101 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/labmarchingsquaresmoduledefine.h>
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+// Connected isoline given by the indices [begin, end) of ContourGeometry::indices,
+// consecutive indices are joined by a line segment and a closed polyline also
+// joins the last index back to the first one
+struct Polyline
+{
+    size_t begin = 0;
+    size_t end = 0;
+    bool closed = false;
+
+    size_t size() const { return end - begin; }
+};
+
+// Isolines of one isovalue as shared vertices in normalized [0,1]^2 coordinates.
+// The indices of all polylines are kept one after the other in indices.
+struct IVW_MODULE_LABMARCHINGSQUARES_API ContourGeometry
+{
+    std::vector<glm::vec2> vertices;
+    std::vector<std::uint32_t> indices;
+    std::vector<Polyline> polylines;
+
+    size_t getNumberOfSegments() const;
+    void clear();
+};
+
+// Up to two vertices joined to a shared vertex by a segment, in either slot,
+// unused slots are noVertex
+using VertexLinks = std::array<std::uint32_t, 2>;
+constexpr std::uint32_t noVertex = 0xffffffffu;
+
+// Record the segment between the vertices a and b in their links. The free slot
+// is indexed rather than branched to, which one it is varies with every cell.
+inline void linkVertices(std::vector<VertexLinks>& links, std::uint32_t a, std::uint32_t b)
+{
+    auto& slotsA = links[a];
+    slotsA[slotsA[0] != noVertex] = b;
+    auto& slotsB = links[b];
+    slotsB[slotsB[0] != noVertex] = a;
+}
+
+// Join the vertices into maximal polylines along their links and replace the
+// indices and polylines of out. Every vertex may be used by at most two segments,
+// which holds for edge crossings of a marching squares grid. Open polylines come
+// first, ordered by their smallest end vertex, followed by the closed ones. The
+// links are used to mark the visited vertices and are invalid afterwards.
+IVW_MODULE_LABMARCHINGSQUARES_API void stitchPolylines(std::vector<VertexLinks>& links,
+    ContourGeometry& out);
+
+// Shared vertices of one isovalue extracted from the cell rows [firstRow, endRow),
+// with the links of the segments between them. Vertices on the bottom edges of the first row and on the
+// top edges of the last row are listed as (cell column, vertex) so that
+// neighboring bands can be joined.
+struct IVW_MODULE_LABMARCHINGSQUARES_API PolylineBand
+{
+    std::vector<glm::vec2> vertices;
+    std::vector<VertexLinks> links;
+    std::vector<std::array<std::uint32_t, 2>> bottomSeam;
+    std::vector<std::array<std::uint32_t, 2>> topSeam;
+    size_t firstRow = 0;
+    size_t endRow = 0;
+
+    void clear();
+};
+
+// Buffers of mergePolylineBands that are kept between calls
+struct PolylineMergeScratch
+{
+    std::vector<VertexLinks> links;
+    std::vector<std::uint32_t> previousTop;
+    std::vector<std::uint32_t> remap;
+};
+
+// Join bands ordered by row into one contour. A crossing on the seam between
+// two directly adjacent bands becomes a single vertex, kept at the position
+// of the lower band, so the result is the same as extracting all rows at once.
+// Scratch kept by the caller saves its allocation on repeated calls.
+IVW_MODULE_LABMARCHINGSQUARES_API void mergePolylineBands(const PolylineBand* bands, size_t numBands,
+    size_t cellsX, ContourGeometry& out, PolylineMergeScratch* scratch = nullptr);
+
+} // namespace contouring
+} // namespace inviwo
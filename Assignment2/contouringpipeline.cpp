@@ -0,0 +1,28 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/contouringpipeline.h>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+std::vector<double> evenlySpacedIsovalues(float lo, float hi, size_t count)
+{
+    // Spacing and values in float, like the isovalue property they come from
+    const float w = (hi - lo) / (count + 1);
+    std::vector<double> isoValues;
+    for (size_t k = 0; k < count; k++)
+    {
+        isoValues.push_back(lo + (k + 1) * w);
+    }
+    return isoValues;
+}
+
+} // namespace contouring
+} // namespace inviwo
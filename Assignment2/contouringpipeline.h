@@ -0,0 +1,202 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/labmarchingsquaresmoduledefine.h>
+#include <labmarchingsquares/contourfollowing.h>
+#include <labmarchingsquares/contourgeometry.h>
+#include <labmarchingsquares/gaussianfilter.h>
+#include <labmarchingsquares/marchingsquarescell.h>
+#include <labmarchingsquares/minmaxpyramid.h>
+#include <labmarchingsquares/polylineextraction.h>
+#include <labmarchingsquares/profiling.h>
+#include <labmarchingsquares/scalarfield.h>
+#include <labmarchingsquares/segmentextraction.h>
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <vector>
+
+// Entry point of the contouring library for code outside of the processor. A
+// field is smoothed with smoothField if wanted, then extractContours picks the
+// kernel for the extraction mode and keeps the pyramid or seeds it builds, so
+// further isovalues of the same field are cheaper.
+
+namespace inviwo
+{
+namespace contouring
+{
+
+// How contours are extracted, values match propExtraction
+enum class Extraction
+{
+    // Independent line segments per cell (see extractSegments)
+    Segments = 0,
+    // Shared vertices joined into polylines by a sweep over the rows (see extractPolylines)
+    Polylines = 1,
+    // Polylines traced from seed cells (see followContours)
+    Following = 2
+};
+
+struct ContouringSettings
+{
+    Decider decider = Decider::Midpoint;
+    Extraction extraction = Extraction::Polylines;
+    // Threads for one field, 0 uses one thread per core
+    size_t numThreads = 0;
+    // Checked by the extraction kernels while they run, see isCancelled
+    const std::atomic<bool>* cancel = nullptr;
+};
+
+// Acceleration structures of one field, each is built the first time an
+// extraction needs it and has to be cleared when the field changes
+struct FieldAcceleration
+{
+    MinMaxPyramid pyramid;
+    ContourSeeds seeds;
+};
+
+// Scratch buffers of the extraction kernels, kept by callers that extract
+// repeatedly so that the steady state does not allocate them again
+struct ExtractionWorkspace
+{
+    SegmentWorkspace segments;
+    PolylineWorkspace polylines;
+};
+
+// Contours of the ascending isovalues of one extraction, segments[level] is
+// filled for Extraction::Segments and contours[level] otherwise
+struct ContourLevels
+{
+    std::vector<std::vector<glm::vec2>> segments;
+    std::vector<ContourGeometry> contours;
+};
+
+// Wall time in ms of one extraction and what its kernels did
+struct ContouringStats
+{
+    // Building the pyramid or the seeds
+    double acceleration = 0.0;
+    double extraction = 0.0;
+    ExtractionCounters counters;
+};
+
+// Isovalues evenly spaced strictly inside [lo, hi], the same ones the processor
+// shows for count contours
+IVW_MODULE_LABMARCHINGSQUARES_API std::vector<double> evenlySpacedIsovalues(float lo, float hi,
+    size_t count);
+
+// Copy the samples of field as floats into values, which is resized to the field
+template <typename T>
+void gatherField(const FieldView<T>& field, std::vector<float>& values)
+{
+    values.resize(field.nx * field.ny);
+    for (size_t j = 0; j < field.ny; j++)
+    {
+        const T* row = field.row(j);
+        for (size_t i = 0; i < field.nx; i++)
+        {
+            values[j * field.nx + i] = static_cast<float>(row[i]);
+        }
+    }
+}
+
+// Copy every stride-th sample of field along x and y as floats into values and
+// return a view of the copy. It covers the samples [0, (nx - 1) * stride] x
+// [0, (ny - 1) * stride] of field, where nx and ny are its dimensions.
+template <typename T>
+FieldView<float> subsampleField(const FieldView<T>& field, size_t stride, std::vector<float>& values)
+{
+    const size_t nx = (field.nx - 1) / stride + 1;
+    const size_t ny = (field.ny - 1) / stride + 1;
+    values.resize(nx * ny);
+    for (size_t j = 0; j < ny; j++)
+    {
+        const T* row = field.row(j * stride);
+        for (size_t i = 0; i < nx; i++)
+        {
+            values[j * nx + i] = static_cast<float>(row[i * stride]);
+        }
+    }
+    return FieldView<float>(values.data(), nx, ny);
+}
+
+// Buffers of smoothField that are kept between calls
+struct SmoothingScratch
+{
+    std::vector<float> values;
+    std::vector<float> rowPass;
+};
+
+// Smooth field with filter into smoothed, which is resized to the field. The
+// field is gathered into a float buffer first. A cancelled filter leaves smoothed
+// incomplete (see GaussianFilter::apply). Scratch kept by the caller saves the
+// allocation of both buffers on repeated calls.
+template <typename T>
+GaussianFilterStats smoothField(const FieldView<T>& field, const GaussianFilter& filter,
+    std::vector<float>& smoothed, size_t numThreads = 0, const std::atomic<bool>* cancel = nullptr,
+    SmoothingScratch* scratch = nullptr)
+{
+    SmoothingScratch local;
+    SmoothingScratch& buffers = scratch ? *scratch : local;
+    gatherField(field, buffers.values);
+
+    smoothed.resize(field.nx * field.ny);
+    return filter.apply(buffers.values.data(), smoothed.data(), field.nx, field.ny, numThreads, cancel,
+        &buffers.rowPass);
+}
+
+// Extract the isolines of the ascending isovalues [begin, end) of field into out,
+// building what acceleration is missing for the extraction mode. The time taken
+// and the counters are added to stats. The vectors of out are reused, like the
+// workspace if one is given. If settings.cancel is set during the extraction, out
+// is left empty.
+template <typename T>
+void extractContours(const FieldView<T>& field, const double* begin, const double* end,
+    const ContouringSettings& settings, FieldAcceleration& acceleration, ContourLevels& out,
+    ContouringStats& stats, ExtractionWorkspace* workspace = nullptr)
+{
+    // Contour following starts from its seeds, the scans skip blocks with the pyramid
+    const bool following = settings.extraction == Extraction::Following;
+    if (following && acceleration.seeds.empty())
+    {
+        StageTimer timer(stats.acceleration);
+        acceleration.seeds.build(field);
+        stats.counters.countBytes(acceleration.seeds.getByteSize());
+    }
+    else if (!following && acceleration.pyramid.empty())
+    {
+        StageTimer timer(stats.acceleration);
+        acceleration.pyramid.build(field, settings.numThreads);
+        stats.counters.countBytes(acceleration.pyramid.getByteSize());
+    }
+
+    StageTimer timer(stats.extraction);
+    switch (settings.extraction)
+    {
+    case Extraction::Segments:
+        out.contours.clear();
+        extractSegments(field, begin, end, settings.decider, &acceleration.pyramid, out.segments,
+            settings.numThreads, &stats.counters, workspace ? &workspace->segments : nullptr, settings.cancel);
+        break;
+    case Extraction::Polylines:
+        out.segments.clear();
+        extractPolylines(field, begin, end, settings.decider, out.contours, &acceleration.pyramid,
+            settings.numThreads, &stats.counters, workspace ? &workspace->polylines : nullptr,
+            settings.cancel);
+        break;
+    case Extraction::Following:
+        out.segments.clear();
+        followContours(field, begin, end, settings.decider, acceleration.seeds, out.contours,
+            settings.numThreads, &stats.counters, settings.cancel);
+        break;
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,109 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/contourio.h>
+
+#include <limits>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+namespace
+{
+
+// Digits that let the text format be read back to the same floats and doubles
+constexpr int floatDigits = std::numeric_limits<float>::max_digits10;
+constexpr int doubleDigits = std::numeric_limits<double>::max_digits10;
+
+} // namespace
+
+ContourWriter::ContourWriter(std::ostream& os, ContourFormat format, size_t nx, size_t ny,
+    size_t numLevels)
+    : os_(os), format_(format)
+{
+    if (format_ == ContourFormat::Binary)
+    {
+        os_.write("MSQC", 4);
+        put<std::uint32_t>(1);
+        put<std::uint64_t>(nx);
+        put<std::uint64_t>(ny);
+        put<std::uint32_t>(static_cast<std::uint32_t>(numLevels));
+    }
+    else
+    {
+        os_ << "contours " << nx << " " << ny << " " << numLevels << "\n";
+    }
+}
+
+void ContourWriter::writeLevel(double isoValue, const ContourGeometry& contour)
+{
+    if (format_ == ContourFormat::Binary)
+    {
+        put<double>(isoValue);
+        put<std::uint8_t>(1);
+        putPoints(contour.vertices);
+        put<std::uint64_t>(contour.polylines.size());
+        for (const auto& line : contour.polylines)
+        {
+            put<std::uint8_t>(line.closed ? 1 : 0);
+            put<std::uint64_t>(line.size());
+            os_.write(reinterpret_cast<const char*>(contour.indices.data() + line.begin),
+                line.size() * sizeof(std::uint32_t));
+        }
+        return;
+    }
+
+    os_.precision(doubleDigits);
+    os_ << "polylines " << isoValue << " " << contour.vertices.size() << " "
+        << contour.polylines.size() << "\n";
+    os_.precision(floatDigits);
+    for (const auto& v : contour.vertices)
+    {
+        os_ << v.x << " " << v.y << "\n";
+    }
+    for (const auto& line : contour.polylines)
+    {
+        os_ << (line.closed ? "closed " : "open ") << line.size();
+        for (size_t i = line.begin; i < line.end; i++)
+        {
+            os_ << " " << contour.indices[i];
+        }
+        os_ << "\n";
+    }
+}
+
+void ContourWriter::writeLevel(double isoValue, const std::vector<glm::vec2>& segments)
+{
+    if (format_ == ContourFormat::Binary)
+    {
+        put<double>(isoValue);
+        put<std::uint8_t>(0);
+        putPoints(segments);
+        return;
+    }
+
+    os_.precision(doubleDigits);
+    os_ << "segments " << isoValue << " " << segments.size() << "\n";
+    os_.precision(floatDigits);
+    for (size_t k = 0; k + 1 < segments.size(); k += 2)
+    {
+        os_ << segments[k].x << " " << segments[k].y << " " << segments[k + 1].x << " "
+            << segments[k + 1].y << "\n";
+    }
+}
+
+void ContourWriter::putPoints(const std::vector<glm::vec2>& points)
+{
+    put<std::uint64_t>(points.size());
+    // glm::vec2 is two packed floats
+    os_.write(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(glm::vec2));
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,74 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/labmarchingsquaresmoduledefine.h>
+#include <labmarchingsquares/contourgeometry.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+enum class ContourFormat
+{
+    Binary, Text
+};
+
+/** Writes the contours of one field to a stream, one level after the other.
+
+    Binary files hold, in native byte order:
+        header  "MSQC", uint32 version (1), uint64 nx, uint64 ny, uint32 number of levels
+        level   float64 isovalue, uint8 kind (0 segments, 1 polylines), then
+                segments:  uint64 number of points, float32 x, y per point,
+                           two consecutive points form a segment
+                polylines: uint64 number of vertices, float32 x, y per vertex,
+                           uint64 number of polylines, per polyline uint8 closed,
+                           uint64 number of indices and uint32 indices
+
+    Text files hold the same numbers with one record per line:
+        contours <nx> <ny> <levels>
+        segments <isovalue> <points>            followed by  <x0> <y0> <x1> <y1>
+        polylines <isovalue> <vertices> <lines> followed by  <x> <y>  and  open|closed <n> <indices>
+
+    Vertices are in the normalized [0,1]^2 coordinates of the field. Stream
+    errors are not reported here, the caller checks the stream when done.
+*/
+class IVW_MODULE_LABMARCHINGSQUARES_API ContourWriter
+{
+//Construction / Deconstruction
+public:
+    // Writes the header, numLevels levels have to follow
+    ContourWriter(std::ostream& os, ContourFormat format, size_t nx, size_t ny, size_t numLevels);
+
+//Methods
+public:
+    void writeLevel(double isoValue, const ContourGeometry& contour);
+
+    // Segments as pairs of end points
+    void writeLevel(double isoValue, const std::vector<glm::vec2>& segments);
+
+private:
+    template <typename T>
+    void put(T value) { os_.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+    void putPoints(const std::vector<glm::vec2>& points);
+
+//Attributes
+private:
+    std::ostream& os_;
+    ContourFormat format_;
+};
+
+} // namespace contouring
+} // namespace inviwo
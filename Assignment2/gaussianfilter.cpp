@@ -0,0 +1,227 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/gaussianfilter.h>
+#include <labmarchingsquares/parallelfor.h>
+#include <labmarchingsquares/profiling.h>
+#include <labmarchingsquares/simd.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+GaussianFilter::GaussianFilter(float sigma)
+    : sigma_(sigma)
+    , radius_(radiusForSigma(sigma))
+{
+    kernel_.resize(2 * radius_ + 1);
+
+    // exp(-x^2 / (2 sigma^2)), the constant factor cancels in the normalization
+    double total = 0.0;
+    for (int k = -radius_; k <= radius_; k++)
+    {
+        const double w = std::exp(-(k * k) / (2.0 * sigma * sigma));
+        kernel_[k + radius_] = static_cast<float>(w);
+        total += w;
+    }
+    for (auto& w : kernel_)
+    {
+        w = static_cast<float>(w / total);
+    }
+
+    prefix_.resize(kernel_.size() + 1, 0.0f);
+    for (size_t i = 0; i < kernel_.size(); i++)
+    {
+        prefix_[i + 1] = prefix_[i] + kernel_[i];
+    }
+}
+
+int GaussianFilter::radiusForSigma(float sigma)
+{
+    return std::max(1, static_cast<int>(std::ceil(3.0f * sigma)));
+}
+
+float GaussianFilter::weightSum(int lo, int hi) const
+{
+    return prefix_[hi + radius_ + 1] - prefix_[lo + radius_];
+}
+
+GaussianFilterStats GaussianFilter::apply(const float* src, float* dst, size_t nx, size_t ny,
+    size_t numThreads, const std::atomic<bool>* cancel, std::vector<float>* scratch) const
+{
+    GaussianFilterStats stats;
+    stats.radius = radius_;
+    stats.threads = resolveThreadCount(numThreads, ny);
+    {
+        StageTimer timer(stats.milliseconds);
+
+        std::vector<float> local;
+        std::vector<float>& tmp = scratch ? *scratch : local;
+        tmp.resize(nx * ny);
+
+        // Every thread filters its rows in blocks, cancel is checked before each block
+        const size_t blockRows = 64;
+        parallelFor(ny, stats.threads, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t y = begin; y < end && !isCancelled(cancel); y += blockRows)
+            {
+                const size_t yEnd = std::min(y + blockRows, end);
+                rowPass(src, nx, y, yEnd, 0, nx, tmp.data() + y * nx, nx);
+            }
+        });
+        parallelFor(ny, stats.threads, [&](size_t begin, size_t end, size_t)
+        {
+            for (size_t y = begin; y < end && !isCancelled(cancel); y += blockRows)
+            {
+                columnPass(tmp.data(), 0, nx, nx, ny, y, std::min(y + blockRows, end), 0, nx, dst);
+            }
+        });
+    }
+    stats.cancelled = isCancelled(cancel);
+    return stats;
+}
+
+GaussianFilterStats GaussianFilter::applyRegion(const float* src, float* dst, size_t nx, size_t ny,
+    size_t x0, size_t y0, size_t x1, size_t y1, size_t numThreads, std::vector<float>* scratch) const
+{
+    GaussianFilterStats stats;
+    stats.radius = radius_;
+    if (x0 >= x1 || y0 >= y1) return stats;
+    {
+        StageTimer timer(stats.milliseconds);
+
+        // The column pass needs the row pass of the rows within the radius
+        const size_t r = static_cast<size_t>(radius_);
+        const size_t tmpBegin = y0 > r ? y0 - r : 0;
+        const size_t tmpEnd = std::min(ny, y1 + r);
+        const size_t width = x1 - x0;
+        std::vector<float> local;
+        std::vector<float>& tmp = scratch ? *scratch : local;
+        tmp.resize(width * (tmpEnd - tmpBegin));
+
+        stats.threads = resolveThreadCount(numThreads, tmpEnd - tmpBegin);
+        parallelFor(tmpEnd - tmpBegin, stats.threads, [&](size_t begin, size_t end, size_t)
+        {
+            rowPass(src, nx, tmpBegin + begin, tmpBegin + end, x0, x1, tmp.data() + begin * width, width);
+        });
+        parallelFor(y1 - y0, stats.threads, [&](size_t begin, size_t end, size_t)
+        {
+            columnPass(tmp.data(), tmpBegin, width, nx, ny, y0 + begin, y0 + end, x0, x1, dst);
+        });
+    }
+    return stats;
+}
+
+void GaussianFilter::rowPass(const float* src, size_t nx, size_t rowBegin, size_t rowEnd,
+    size_t colBegin, size_t colEnd, float* dst, size_t dstStride) const
+{
+    const int r = radius_;
+    const int width = static_cast<int>(nx);
+    const int first = static_cast<int>(colBegin);
+    const int last = static_cast<int>(colEnd);
+    const float* w = kernel_.data() + r; // w[k] for k in [-r, r]
+
+    // Columns [interiorBegin, interiorEnd) see the full kernel
+    const int interiorBegin = std::min(std::max(r, first), last);
+    const int interiorEnd = std::max(interiorBegin, std::min(width - r, last));
+
+    for (size_t y = rowBegin; y < rowEnd; y++)
+    {
+        const float* in = src + y * nx;
+        float* out = dst + (y - rowBegin) * dstStride;
+
+        auto border = [&](int x)
+        {
+            const int lo = std::max(-r, -x);
+            const int hi = std::min(r, width - 1 - x);
+            float total = 0.0f;
+            for (int k = lo; k <= hi; k++)
+            {
+                total += w[k] * in[x + k];
+            }
+            out[x - first] = total / weightSum(lo, hi);
+        };
+
+        for (int x = first; x < interiorBegin; x++) border(x);
+
+        int x = interiorBegin;
+#ifdef LABMARCHINGSQUARES_SSE
+        for (; x + 4 <= interiorEnd; x += 4)
+        {
+            __m128 acc = _mm_setzero_ps();
+            for (int k = -r; k <= r; k++)
+            {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(in + x + k)));
+            }
+            _mm_storeu_ps(out + x - first, acc);
+        }
+#endif
+        for (; x < interiorEnd; x++)
+        {
+            float total = 0.0f;
+            for (int k = -r; k <= r; k++)
+            {
+                total += w[k] * in[x + k];
+            }
+            out[x - first] = total;
+        }
+
+        for (x = interiorEnd; x < last; x++) border(x);
+    }
+}
+
+void GaussianFilter::columnPass(const float* src, size_t srcRow, size_t srcStride, size_t nx,
+    size_t ny, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd, float* dst) const
+{
+    const int r = radius_;
+    const int height = static_cast<int>(ny);
+    const float* w = kernel_.data() + r;
+
+    for (size_t y = rowBegin; y < rowEnd; y++)
+    {
+        const int iy = static_cast<int>(y);
+        const int lo = std::max(-r, -iy);
+        const int hi = std::min(r, height - 1 - iy);
+        // Clipped rows are renormalized, for interior rows this is 1
+        const float norm = 1.0f / weightSum(lo, hi);
+
+        const float* in = src + (y - srcRow) * srcStride;
+        float* out = dst + y * nx;
+        const std::ptrdiff_t stride = static_cast<std::ptrdiff_t>(srcStride);
+
+        size_t x = colBegin;
+#ifdef LABMARCHINGSQUARES_SSE
+        const __m128 normv = _mm_set1_ps(norm);
+        for (; x + 4 <= colEnd; x += 4)
+        {
+            __m128 acc = _mm_setzero_ps();
+            for (int k = lo; k <= hi; k++)
+            {
+                const float* row = in + static_cast<std::ptrdiff_t>(k) * stride;
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(row + x - colBegin)));
+            }
+            _mm_storeu_ps(out + x, _mm_mul_ps(acc, normv));
+        }
+#endif
+        for (; x < colEnd; x++)
+        {
+            float total = 0.0f;
+            for (int k = lo; k <= hi; k++)
+            {
+                total += w[k] * in[x - colBegin + static_cast<std::ptrdiff_t>(k) * stride];
+            }
+            out[x] = total * norm;
+        }
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,94 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/labmarchingsquaresmoduledefine.h>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+// Timing and setup of one filter run
+struct GaussianFilterStats
+{
+    double milliseconds = 0.0;
+    size_t threads = 0;
+    int radius = 0;
+    // Set if the run was cancelled, the result is incomplete then
+    bool cancelled = false;
+};
+
+/** Separable Gaussian filter for 2D scalar fields stored x-fastest as floats.
+
+    The normalized 1D kernel is computed once per sigma. Filtering runs a row
+    pass followed by a column pass, each split over rows across threads and
+    vectorized over x. At the borders the window is clipped and the remaining
+    weights are renormalized, which gives exactly the same weighting as
+    clipping the full 2D window since the 2D Gaussian factorizes.
+*/
+class IVW_MODULE_LABMARCHINGSQUARES_API GaussianFilter
+{
+//Construction / Deconstruction
+public:
+    explicit GaussianFilter(float sigma);
+
+//Methods
+public:
+    // Radius that covers +-3 sigma, at least one sample
+    static int radiusForSigma(float sigma);
+
+    float getSigma() const { return sigma_; }
+    int getRadius() const { return radius_; }
+    // The 2 * radius + 1 kernel weights, summing up to one
+    const std::vector<float>& getKernel() const { return kernel_; }
+
+    // Smooth the nx * ny field src into dst, the two buffers must not overlap.
+    // numThreads = 0 uses one thread per core. If cancel is given, it is checked
+    // between blocks of rows and the filter stops once it is set. The result of
+    // the row pass goes to scratch if given, which is grown as needed and can be
+    // kept by the caller for the next run, else to a buffer allocated per call.
+    GaussianFilterStats apply(const float* src, float* dst, size_t nx, size_t ny,
+        size_t numThreads = 0, const std::atomic<bool>* cancel = nullptr,
+        std::vector<float>* scratch = nullptr) const;
+
+    // Smooth only the samples [x0, x1) x [y0, y1) of dst, which get the same values
+    // as from apply. Only rows within the radius of the region are read from src.
+    GaussianFilterStats applyRegion(const float* src, float* dst, size_t nx, size_t ny,
+        size_t x0, size_t y0, size_t x1, size_t y1, size_t numThreads = 0,
+        std::vector<float>* scratch = nullptr) const;
+
+private:
+    // Sum of the kernel weights for offsets [lo, hi] relative to the center
+    float weightSum(int lo, int hi) const;
+
+    // Filter the columns [colBegin, colEnd) of the rows [rowBegin, rowEnd) of the
+    // nx wide field src along x. Sample (x, y) goes to dst[(y - rowBegin) *
+    // dstStride + x - colBegin].
+    void rowPass(const float* src, size_t nx, size_t rowBegin, size_t rowEnd, size_t colBegin,
+        size_t colEnd, float* dst, size_t dstStride) const;
+    // Filter the same part of the nx * ny field along y, reading sample (x, y)
+    // of the row pass from src[(y - srcRow) * srcStride + x - colBegin] and
+    // writing it to dst[y * nx + x]
+    void columnPass(const float* src, size_t srcRow, size_t srcStride, size_t nx, size_t ny,
+        size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd, float* dst) const;
+
+//Attributes
+private:
+    float sigma_;
+    int radius_;
+    std::vector<float> kernel_;
+    // prefix_[i] is the sum of kernel_[0, i)
+    std::vector<float> prefix_;
+};
+
+} // namespace contouring
+} // namespace inviwo
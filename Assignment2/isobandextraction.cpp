@@ -0,0 +1,84 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/isobandextraction.h>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+void BandPiece::clear()
+{
+    vertices.clear();
+    triangles.clear();
+    bottomSeam.clear();
+    topSeam.clear();
+}
+
+void mergeBandPieces(const BandPiece* pieces, size_t numPieces, size_t nx, BandGeometry& out)
+{
+    const std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+
+    out.vertices.clear();
+    out.triangles.clear();
+
+    size_t numVertices = 0;
+    size_t numIndices = 0;
+    for (size_t p = 0; p < numPieces; p++)
+    {
+        numVertices += pieces[p].vertices.size();
+        numIndices += pieces[p].triangles.size();
+    }
+    out.vertices.reserve(numVertices);
+    out.triangles.reserve(numIndices);
+
+    // Merged vertices on the top sample row of the previous piece, by seam key
+    std::vector<std::uint32_t> previousTop(3 * nx, none);
+    std::vector<std::uint32_t> remap;
+
+    for (size_t p = 0; p < numPieces; p++)
+    {
+        const BandPiece& piece = pieces[p];
+        remap.assign(piece.vertices.size(), none);
+
+        if (p > 0 && pieces[p - 1].endRow == piece.firstRow)
+        {
+            for (const auto& seam : piece.bottomSeam)
+            {
+                remap[seam[1]] = previousTop[seam[0]];
+            }
+        }
+        for (size_t v = 0; v < piece.vertices.size(); v++)
+        {
+            if (remap[v] == none)
+            {
+                remap[v] = static_cast<std::uint32_t>(out.vertices.size());
+                out.vertices.push_back(piece.vertices[v]);
+            }
+        }
+        for (const auto index : piece.triangles)
+        {
+            out.triangles.push_back(remap[index]);
+        }
+
+        if (p > 0)
+        {
+            for (const auto& seam : pieces[p - 1].topSeam)
+            {
+                previousTop[seam[0]] = none;
+            }
+        }
+        for (const auto& seam : piece.topSeam)
+        {
+            previousTop[seam[0]] = remap[seam[1]];
+        }
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,457 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/labmarchingsquaresmoduledefine.h>
+#include <labmarchingsquares/marchingsquarescell.h>
+#include <labmarchingsquares/parallelfor.h>
+#include <labmarchingsquares/profiling.h>
+#include <labmarchingsquares/scalarfield.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+// Filled region of one band of values as triangles over shared vertices in
+// normalized [0,1]^2 coordinates, three indices per triangle in counterclockwise order
+struct IVW_MODULE_LABMARCHINGSQUARES_API BandGeometry
+{
+    std::vector<glm::vec2> vertices;
+    std::vector<std::uint32_t> triangles;
+};
+
+// Triangles of one band extracted from the cell rows [firstRow, endRow). Vertices
+// on the sample rows firstRow and endRow are listed as (key, vertex) so that
+// neighboring pieces can be joined. The key of the sample x is x, that of the
+// crossing on the horizontal edge x is nx + 2x for the isovalue above the band
+// and nx + 2x + 1 for the one below.
+struct IVW_MODULE_LABMARCHINGSQUARES_API BandPiece
+{
+    std::vector<glm::vec2> vertices;
+    std::vector<std::uint32_t> triangles;
+    std::vector<std::array<std::uint32_t, 2>> bottomSeam;
+    std::vector<std::array<std::uint32_t, 2>> topSeam;
+    size_t firstRow = 0;
+    size_t endRow = 0;
+
+    void clear();
+};
+
+// Join the pieces of one band, ordered by row, of a field with nx samples per row.
+// A vertex on the seam between two adjacent pieces is kept once.
+IVW_MODULE_LABMARCHINGSQUARES_API void mergeBandPieces(const BandPiece* pieces, size_t numPieces,
+    size_t nx, BandGeometry& out);
+
+namespace detail
+{
+
+// Vertices of the samples of one row and of the crossings on the edges between
+// them, per band. Edge x is crossed by the isovalues [level0[x], level0[x] + n),
+// every crossing has two vertices in pool starting at first[x], one in the band
+// below the isovalue and one in the band above it.
+struct BandEdgeRow
+{
+    std::vector<std::uint32_t> samples;
+    std::vector<std::uint32_t> first;
+    std::vector<std::uint32_t> level0;
+    std::vector<std::uint32_t> pool;
+
+    // Vertex of the crossing of isovalue level on edge x in band, which is level or level + 1
+    std::uint32_t crossing(size_t x, size_t level, size_t band) const
+    {
+        return pool[first[x] + 2 * (level - level0[x]) + (band > level ? 1 : 0)];
+    }
+};
+
+// Point on the boundary of the cell (see CellEdge), either a corner in the band or
+// the crossing of the isovalue level where the walk enters or leaves the band
+struct BandPoint
+{
+    std::uint32_t vertex;
+    int edge;
+    int level;
+    bool enter;
+};
+
+// Buffers of one thread
+struct BandScratch
+{
+    BandEdgeRow below;
+    BandEdgeRow above;
+    BandEdgeRow vertical;
+    std::vector<BandPoint> points;
+    std::vector<std::uint32_t> polygon;
+};
+
+// Band of value v, band k holds the values in [begin[k - 1], begin[k])
+inline size_t bandOf(float v, const double* begin, const double* end)
+{
+    return static_cast<size_t>(firstIsovalueAbove(v, begin, end) - begin);
+}
+
+// Add the vertex of p to pieces[band * pieceStride] and to its seam if seam is given
+inline std::uint32_t addBandVertex(BandPiece* pieces, size_t pieceStride, size_t band, const glm::vec2& p,
+    std::vector<std::array<std::uint32_t, 2>> BandPiece::*seam, size_t key)
+{
+    BandPiece& piece = pieces[band * pieceStride];
+    const auto vertex = static_cast<std::uint32_t>(piece.vertices.size());
+    piece.vertices.push_back(p);
+    if (seam)
+    {
+        (piece.*seam).push_back({ { static_cast<std::uint32_t>(key), vertex } });
+    }
+    return vertex;
+}
+
+// Create the crossings of the edge x of row from the sample a at (ex, ey) with vertex va
+// to the sample b one step in direction (dx, dy) with vertex vb. They are interpolated
+// like the polylines, from the lower or left sample. An isovalue equal to the larger
+// sample crosses at that sample, which is then its vertex in the band above.
+inline void addEdgeCrossings(float a, float b, float ex, float ey, float dx, float dy, float extentX,
+    float extentY, std::uint32_t va, std::uint32_t vb, const double* begin, const double* end,
+    BandPiece* pieces, size_t pieceStride, std::vector<std::array<std::uint32_t, 2>> BandPiece::*seam,
+    size_t key, size_t x, BandEdgeRow& row)
+{
+    // The edge is crossed by the isovalues in (min, max]
+    const size_t level0 = bandOf(std::min(a, b), begin, end);
+    const size_t level1 = bandOf(std::max(a, b), begin, end);
+    row.first[x] = static_cast<std::uint32_t>(row.pool.size());
+    row.level0[x] = static_cast<std::uint32_t>(level0);
+    for (size_t level = level0; level < level1; level++)
+    {
+        const double c = begin[level];
+        const glm::vec2 p = edgePoint(c, a, b, ex, ey, dx, dy, extentX, extentY);
+        row.pool.push_back(addBandVertex(pieces, pieceStride, level, p, seam, key));
+        if (c == std::max(a, b))
+        {
+            row.pool.push_back(a > b ? va : vb);
+        }
+        else
+        {
+            row.pool.push_back(addBandVertex(pieces, pieceStride, level + 1, p, seam, key + 1));
+        }
+    }
+}
+
+// Create the vertices of the samples of row y and of the crossings on the edges
+// between them for all bands. If seam is given they are also listed there.
+template <typename T>
+void createSampleRow(const FieldView<T>& field, const double* begin, const double* end, size_t y,
+    BandPiece* pieces, size_t pieceStride, std::vector<std::array<std::uint32_t, 2>> BandPiece::*seam,
+    BandEdgeRow& row, ExtractionCounters& counters)
+{
+    const size_t nx = field.nx;
+    const float extentX = static_cast<float>(nx - 1);
+    const float extentY = static_cast<float>(field.ny - 1);
+    const T* values = field.row(y);
+
+    row.samples.resize(nx);
+    for (size_t x = 0; x < nx; x++)
+    {
+        row.samples[x] = addBandVertex(pieces, pieceStride, bandOf(static_cast<float>(values[x]), begin, end),
+            glm::vec2(x / extentX, y / extentY), seam, x);
+    }
+
+    row.first.resize(nx - 1);
+    row.level0.resize(nx - 1);
+    row.pool.clear();
+    for (size_t x = 0; x + 1 < nx; x++)
+    {
+        addEdgeCrossings(static_cast<float>(values[x]), static_cast<float>(values[x + 1]),
+            static_cast<float>(x), static_cast<float>(y), 1.0f, 0.0f, extentX, extentY, row.samples[x],
+            row.samples[x + 1], begin, end, pieces, pieceStride, seam, nx + 2 * x, x, row);
+    }
+    counters.countVertices(nx + row.pool.size());
+}
+
+// Create the vertices of the crossings on the vertical edges between the sample rows
+// y and y + 1 for all bands, below and above hold the vertices of those rows
+template <typename T>
+void createVerticalEdges(const FieldView<T>& field, const double* begin, const double* end, size_t y,
+    BandPiece* pieces, size_t pieceStride, const BandEdgeRow& below, const BandEdgeRow& above,
+    BandEdgeRow& vertical, ExtractionCounters& counters)
+{
+    const size_t nx = field.nx;
+    const float extentX = static_cast<float>(nx - 1);
+    const float extentY = static_cast<float>(field.ny - 1);
+    const T* valuesBelow = field.row(y);
+    const T* valuesAbove = field.row(y + 1);
+
+    vertical.first.resize(nx);
+    vertical.level0.resize(nx);
+    vertical.pool.clear();
+    for (size_t x = 0; x < nx; x++)
+    {
+        addEdgeCrossings(static_cast<float>(valuesBelow[x]), static_cast<float>(valuesAbove[x]),
+            static_cast<float>(x), static_cast<float>(y), 0.0f, 1.0f, extentX, extentY, below.samples[x],
+            above.samples[x], begin, end, pieces, pieceStride, nullptr, 0, x, vertical);
+    }
+    counters.countVertices(vertical.pool.size());
+}
+
+// Triangulate the part of band in cell (ix, iy) with corner values f = { f00, f01,
+// f11, f10 }. Its boundary alternates between pieces of the cell boundary and
+// isoline segments of the isovalues below and above the band, the segments are
+// those of cellSegments, so the band edges match the isolines.
+inline void appendCellBand(size_t ix, const float f[4], size_t band, const double* begin,
+    const double* end, Decider decider, BandScratch& scratch, std::vector<std::uint32_t>& triangles)
+{
+    const size_t numLevels = end - begin;
+    auto inside = [&](float v) { return (band == 0 || v >= begin[band - 1]) && (band == numLevels || v < begin[band]); };
+
+    // Walk around the cell, the corners in the band and the crossings of its two isovalues
+    auto& points = scratch.points;
+    points.clear();
+    for (int e = 0; e < 4; e++)
+    {
+        const float a = f[e];
+        const float b = f[(e + 1) % 4];
+        if (inside(a))
+        {
+            const std::uint32_t vertex = e == 0 ? scratch.below.samples[ix] : e == 1 ?
+                scratch.above.samples[ix] : e == 2 ? scratch.above.samples[ix + 1] : scratch.below.samples[ix + 1];
+            points.push_back({ vertex, e, -1, false });
+        }
+
+        // The isovalue below the band is crossed first on the way up
+        int levels[2] = { static_cast<int>(band) - 1, static_cast<int>(band) };
+        if (a > b) std::swap(levels[0], levels[1]);
+        for (const int level : levels)
+        {
+            if (level < 0 || level >= static_cast<int>(numLevels)) continue;
+            const double c = begin[level];
+            if ((a >= c) == (b >= c)) continue;
+
+            const BandEdgeRow& row = e == 1 ? scratch.above : e == 3 ? scratch.below : scratch.vertical;
+            const size_t x = e == 2 ? ix + 1 : ix;
+            const bool enter = (a < b) == (level == static_cast<int>(band) - 1);
+            points.push_back({ row.crossing(x, level, band), e, level, enter });
+        }
+    }
+
+    // A walk that never crosses stays in the band
+    const auto firstEnter = std::find_if(points.begin(), points.end(),
+        [](const BandPoint& p) { return p.level >= 0 && p.enter; });
+    if (firstEnter == points.end())
+    {
+        if (points.size() == 4)
+        {
+            triangles.insert(triangles.end(), { points[0].vertex, points[3].vertex, points[2].vertex,
+                points[0].vertex, points[2].vertex, points[1].vertex });
+        }
+        return;
+    }
+    std::rotate(points.begin(), firstEnter, points.end());
+
+    // Every arc runs from an entering crossing to the next leaving one, an arc is
+    // followed by the one that starts where the isoline segment from its end leads
+    size_t arcs[4][2];
+    size_t numArcs = 0;
+    for (size_t p = 0; p < points.size(); p++)
+    {
+        if (points[p].level < 0) continue;
+        if (points[p].enter)
+        {
+            arcs[numArcs][0] = p;
+        }
+        else
+        {
+            arcs[numArcs++][1] = p;
+        }
+    }
+
+    bool done[4] = { false, false, false, false };
+    for (size_t start = 0; start < numArcs; start++)
+    {
+        if (done[start]) continue;
+        auto& polygon = scratch.polygon;
+        polygon.clear();
+        for (size_t arc = start; !done[arc];)
+        {
+            done[arc] = true;
+            for (size_t p = arcs[arc][0]; p <= arcs[arc][1]; p++)
+            {
+                polygon.push_back(points[p].vertex);
+            }
+
+            const BandPoint& exit = points[arcs[arc][1]];
+            EdgePair pairs[2];
+            const int numSegments = cellSegments(f[0], f[1], f[2], f[3], begin[exit.level], decider, pairs);
+            int next = -1;
+            for (int s = 0; s < numSegments; s++)
+            {
+                if (pairs[s].first == exit.edge) next = pairs[s].second;
+                if (pairs[s].second == exit.edge) next = pairs[s].first;
+            }
+            for (size_t other = 0; other < numArcs; other++)
+            {
+                const BandPoint& entry = points[arcs[other][0]];
+                if (entry.edge == next && entry.level == exit.level) arc = other;
+            }
+        }
+
+        // A crossing at a corner shares its vertex, the repeated vertex is dropped
+        polygon.erase(std::unique(polygon.begin(), polygon.end()), polygon.end());
+        while (polygon.size() > 1 && polygon.front() == polygon.back()) polygon.pop_back();
+
+        // The part is convex and the walk is clockwise, the fan is emitted the other way around
+        for (size_t k = 1; k + 1 < polygon.size(); k++)
+        {
+            triangles.insert(triangles.end(), { polygon[0], polygon[k + 1], polygon[k] });
+        }
+    }
+}
+
+// Extract the cell rows [firstRow, endRow) for all bands, pieces[band * pieceStride]
+// receives the band below begin[band]
+template <typename T>
+void extractBandRows(const FieldView<T>& field, const double* begin, const double* end, Decider decider,
+    size_t firstRow, size_t endRow, BandScratch& scratch, BandPiece* pieces, size_t pieceStride,
+    ExtractionCounters& counters)
+{
+    const size_t numBands = (end - begin) + 1;
+    for (size_t band = 0; band < numBands; band++)
+    {
+        BandPiece& piece = pieces[band * pieceStride];
+        piece.clear();
+        piece.firstRow = firstRow;
+        piece.endRow = endRow;
+    }
+
+    // Counted locally, the counters of neighboring threads share cache lines
+    ExtractionCounters rowCounters;
+    createSampleRow(field, begin, end, firstRow, pieces, pieceStride, &BandPiece::bottomSeam, scratch.below,
+        rowCounters);
+    for (size_t iy = firstRow; iy < endRow; iy++)
+    {
+        createSampleRow(field, begin, end, iy + 1, pieces, pieceStride,
+            iy + 1 == endRow ? &BandPiece::topSeam : nullptr, scratch.above, rowCounters);
+        createVerticalEdges(field, begin, end, iy, pieces, pieceStride, scratch.below, scratch.above,
+            scratch.vertical, rowCounters);
+
+        const T* rowBelow = field.row(iy);
+        const T* rowAbove = field.row(iy + 1);
+        for (size_t ix = 0; ix + 1 < field.nx; ix++)
+        {
+            const float f[4] = { static_cast<float>(rowBelow[ix]), static_cast<float>(rowAbove[ix]),
+                static_cast<float>(rowAbove[ix + 1]), static_cast<float>(rowBelow[ix + 1]) };
+            const size_t lo = bandOf(std::min({ f[0], f[1], f[2], f[3] }), begin, end);
+            const size_t hi = bandOf(std::max({ f[0], f[1], f[2], f[3] }), begin, end);
+            rowCounters.countActive(lo != hi);
+
+            // Most cells lie in a single band and are split into two triangles
+            if (lo == hi)
+            {
+                const std::uint32_t v00 = scratch.below.samples[ix];
+                const std::uint32_t v01 = scratch.above.samples[ix];
+                const std::uint32_t v11 = scratch.above.samples[ix + 1];
+                const std::uint32_t v10 = scratch.below.samples[ix + 1];
+                pieces[lo * pieceStride].triangles.insert(pieces[lo * pieceStride].triangles.end(),
+                    { v00, v10, v11, v00, v11, v01 });
+                continue;
+            }
+            for (size_t band = lo; band <= hi; band++)
+            {
+                appendCellBand(ix, f, band, begin, end, decider, scratch,
+                    pieces[band * pieceStride].triangles);
+            }
+        }
+        rowCounters.countScanned(field.nx - 1);
+        std::swap(scratch.below, scratch.above);
+    }
+    counters += rowCounters;
+}
+
+} // namespace detail
+
+/** Extract the filled bands between the ascending isovalues [begin, end) as
+    triangles, bands[k] receives the values in [begin[k - 1], begin[k]), where
+    the first band is open below and the last one above, so the bands cover the
+    field.
+
+    Every cell is classified against all isovalues in a single sweep. A cell
+    within one band is split into two triangles, any other cell is cut along the
+    isolines of its isovalues, with ambiguities resolved by decider like for the
+    isolines, and the parts are triangulated. Samples and edge crossings are
+    shared vertices of each band.
+
+    Every block row of cells is a piece scheduled over numThreads threads (0
+    uses one per core), the pieces are joined on their seams. The result does
+    not depend on the thread count. If counters is given, what the extraction
+    did is added to it. If cancel is given, it is checked before every piece.
+    Once it is set the sweep stops and bands is left empty.
+*/
+template <typename T>
+void extractIsobands(const FieldView<T>& field, const double* begin, const double* end, Decider decider,
+    std::vector<BandGeometry>& bands, size_t numThreads = 0, ExtractionCounters* counters = nullptr,
+    const std::atomic<bool>* cancel = nullptr)
+{
+    const size_t numBands = (end - begin) + 1;
+    bands.resize(numBands);
+    for (auto& band : bands)
+    {
+        band.vertices.clear();
+        band.triangles.clear();
+    }
+    if (field.nx < 2 || field.ny < 2) return;
+
+    // Rows of one piece, the same as a block row of the pyramid
+    const size_t rowsPerPiece = 16;
+    const size_t cellsY = field.ny - 1;
+    const size_t numPieces = (cellsY + rowsPerPiece - 1) / rowsPerPiece;
+
+    // Pieces of one band are consecutive
+    std::vector<BandPiece> pieces(numBands * numPieces);
+    const size_t threads = resolveThreadCount(numThreads, numPieces);
+    std::vector<detail::BandScratch> scratch(threads);
+    std::vector<ExtractionCounters> threadCounters(threads);
+    parallelForEach(numPieces, threads, [&](size_t piece, size_t thread)
+    {
+        if (isCancelled(cancel)) return;
+        const size_t firstRow = piece * rowsPerPiece;
+        detail::extractBandRows(field, begin, end, decider, firstRow, std::min(firstRow + rowsPerPiece, cellsY),
+            scratch[thread], pieces.data() + piece, numPieces, threadCounters[thread]);
+    });
+
+    // The pieces of a cancelled sweep are not all there, they are not merged
+    if (isCancelled(cancel)) return;
+    parallelForEach(numBands, resolveThreadCount(numThreads, numBands), [&](size_t band, size_t)
+    {
+        mergeBandPieces(pieces.data() + band * numPieces, numPieces, field.nx, bands[band]);
+    });
+
+    if (counters)
+    {
+        for (const auto& pieceCounters : threadCounters)
+        {
+            *counters += pieceCounters;
+        }
+        for (const auto& piece : pieces)
+        {
+            counters->countBytes(vectorBytes(piece.vertices) + vectorBytes(piece.triangles) +
+                vectorBytes(piece.bottomSeam) + vectorBytes(piece.topSeam));
+        }
+        for (const auto& band : bands)
+        {
+            counters->countBytes(vectorBytes(band.vertices) + vectorBytes(band.triangles));
+        }
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -9,11 +9,127 @@
  */
 
 #include <labmarchingsquares/marchingsquares.h>
+#include <inviwo/core/common/inviwoapplication.h>
 #include <inviwo/core/util/utilities.h>
+#include <inviwo/core/util/formats.h>
+#include <labmarchingsquares/parallelfor.h>
+#include <labmarchingsquares/streamingextraction.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <tuple>
 
 namespace inviwo
 {
 
+namespace
+{
+
+// Separates the isolines within the strip of one level. It is the largest index, the
+// fixed restart index of GL_PRIMITIVE_RESTART_FIXED_INDEX for 32 bit indices.
+const std::uint32_t restartIndex = std::numeric_limits<std::uint32_t>::max();
+
+template <typename T>
+contouring::FieldView<T> typedField(const VolumeRAM* vr, const size3_t dims, size_t z)
+{
+    return contouring::FieldView<T>(static_cast<const T*>(vr->getData()) + z * dims.x * dims.y, dims.x, dims.y);
+}
+
+// Call func with a typed view of slice zBegin of vr, the slices up to zEnd follow
+// it in memory (see sliceAfter). Scalar formats are read directly from the volume
+// memory, anything else is converted into the float buffer "converted" through
+// getAsDouble once.
+template <typename Func>
+void dispatchScalarField(const VolumeRAM* vr, const size3_t dims, size_t zBegin, size_t zEnd,
+    std::vector<float>& converted, Func&& func)
+{
+    switch (vr->getDataFormat()->getId())
+    {
+    case DataFormatId::Int8: func(typedField<std::int8_t>(vr, dims, zBegin)); break;
+    case DataFormatId::Int16: func(typedField<std::int16_t>(vr, dims, zBegin)); break;
+    case DataFormatId::Int32: func(typedField<std::int32_t>(vr, dims, zBegin)); break;
+    case DataFormatId::UInt8: func(typedField<std::uint8_t>(vr, dims, zBegin)); break;
+    case DataFormatId::UInt16: func(typedField<std::uint16_t>(vr, dims, zBegin)); break;
+    case DataFormatId::UInt32: func(typedField<std::uint32_t>(vr, dims, zBegin)); break;
+    case DataFormatId::Float32: func(typedField<float>(vr, dims, zBegin)); break;
+    case DataFormatId::Float64: func(typedField<double>(vr, dims, zBegin)); break;
+    default:
+        converted.resize((zEnd - zBegin) * dims.x * dims.y);
+        for (size_t z = zBegin; z < zEnd; z++)
+        {
+            for (size_t j = 0; j < dims.y; j++)
+            {
+                for (size_t i = 0; i < dims.x; i++)
+                {
+                    converted[((z - zBegin) * dims.y + j) * dims.x + i] =
+                        static_cast<float>(vr->getAsDouble(size3_t(i, j, z)));
+                }
+            }
+        }
+        func(contouring::FieldView<float>(converted.data(), dims.x, dims.y));
+        break;
+    }
+}
+
+// View of the slice k slices after the one viewed by field
+template <typename T>
+contouring::FieldView<T> sliceAfter(const contouring::FieldView<T>& field, size_t k)
+{
+    return contouring::FieldView<T>(field.data + k * field.ny * field.rowStride, field.nx, field.ny,
+        field.rowStride);
+}
+
+// Smallest stride k such that every k-th of numLines grid lines across the unit
+// square are at least minSpacing apart
+size_t gridLineStride(size_t numLines, float minSpacing)
+{
+    if (numLines < 2) return 1;
+    const double spacing = 1.0 / (numLines - 1);
+    return std::max<size_t>(1, static_cast<size_t>(std::ceil(minSpacing / spacing - 1e-6)));
+}
+
+// Height of slice z in the output mesh, the slices span [0, 1] like x and y
+float sliceHeight(const size3_t& dims, size_t z)
+{
+    return dims.z > 1 ? static_cast<float>(z) / (dims.z - 1) : 0.0f;
+}
+
+// Value in the middle of band k between the ascending isovalues, the outer bands
+// end at minValue and maxValue
+double bandMidValue(const std::vector<double>& isoValues, size_t k, double minValue, double maxValue)
+{
+    const double lower = k > 0 ? isoValues[k - 1] : minValue;
+    const double upper = k < isoValues.size() ? isoValues[k] : maxValue;
+    return 0.5 * (lower + upper);
+}
+
+// Scale points by scale, which maps the part of the unit square a subsampled field
+// covers onto the part of the full field
+void scalePoints(std::vector<vec2>& points, const vec2& scale)
+{
+    for (auto& p : points)
+    {
+        p.x *= scale.x;
+        p.y *= scale.y;
+    }
+}
+
+// The buffer to fill, a new one if a mesh handed out still holds it. The data of
+// a mesh that was handed out must not change.
+template <typename B>
+B& unsharedBuffer(std::shared_ptr<B>& buffer)
+{
+    if (!buffer || buffer.use_count() > 1) buffer = std::make_shared<B>();
+    return *buffer;
+}
+
+} // namespace
+
+
 // The Class Identifier has to be globally unique. Use a reverse DNS naming scheme
 const ProcessorInfo MarchingSquares::processorInfo_
 {
@@ -36,18 +152,80 @@ MarchingSquares::MarchingSquares()
     , meshOut("meshOut")
     , propShowGrid("showGrid", "Show Grid")
     , propDeciderType("deciderType", "Decider Type")
+    , propExtraction("extraction", "Extraction")
+    , propSimplification("simplification", "Simplification")
+    , propSimplifyTolerance("simplifyTolerance", "Tolerance", 0.001f, 0.0f, 0.05f, 0.0001f)
     , propMultiple("multiple", "Iso Levels")
     , propIsoValue("isovalue", "Iso Value")
     , propGridColor("gridColor", "Grid Lines Color", vec4(0.0f, 0.0f, 0.0f, 1.0f),
         vec4(0.0f), vec4(1.0f), vec4(0.1f),
         InvalidationLevel::InvalidOutput, PropertySemantics::Color)
+    , propGridLod("gridLod", "Grid Level of Detail")
+    , propGridSpacing("gridSpacing", "Minimum Grid Spacing", 0.01f, 0.001f, 0.1f, 0.001f)
     , propIsoColor("isoColor", "Color", vec4(0.0f, 0.0f, 1.0f, 1.0f),
         vec4(0.0f), vec4(1.0f), vec4(0.1f),
         InvalidationLevel::InvalidOutput, PropertySemantics::Color)
     , propNumContours("numContours", "Number of Contours", 1, 1, 50, 1)
     , propIsoTransferFunc("isoTransferFunc", "Colors", &inData)
+    , propBands("bands", "Filled Isobands")
+    , propMeshFormat("meshFormat", "Mesh Format")
 	, propApplyGaussian("filter", "Gaussian Filter")
 	, propSigma("sigma", "Sigma", 0.5f, 0.1f, 1.0f, 0.01f)
+	, propSlices("slices", "Slices")
+	, propSliceRange("sliceRange", "Slice Range", 0, 0, 0, 0, 1, 0)
+	, propThreads("threads", "Threads", 0, 0, 64, 1)
+	, propBackground("background", "Background Extraction")
+	, propPreviewStride("previewStride", "Preview Stride", 4, 1, 64, 1)
+	, propTemporalCoherence("temporalCoherence", "Temporal Coherence")
+	, propWorkingCopy("workingCopy", "Compact Working Copy", false)
+	, propStreaming("streaming", "Out-of-Core Streaming")
+	, propStreamEnable("streamEnable", "Stream From File")
+	, propStreamFile("streamFile", "Raw File")
+	, propStreamDims("streamDims", "Dimensions", ivec2(0), ivec2(0), ivec2(std::numeric_limits<int>::max()))
+	, propStreamType("streamType", "Data Type")
+	, propStreamOffset("streamOffset", "Header Bytes", 0, 0, std::numeric_limits<size_t>::max())
+	, propStreamTileSize("streamTileSize", "Tile Size", 512, 16, 8192, 16)
+#if LABMARCHINGSQUARES_PROFILING
+	, propStatistics("statistics", "Statistics")
+	, propStatisticsLog("statisticsLog", "Log Statistics")
+	, propTimeFilter("timeFilter", "Gaussian Filter (ms)", 0.0, 0.0, std::numeric_limits<double>::max(),
+		0.001, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propTimePyramid("timePyramid", "Pyramid / Seeds (ms)", 0.0, 0.0, std::numeric_limits<double>::max(),
+		0.001, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propTimeExtraction("timeExtraction", "Contour Extraction (ms)", 0.0, 0.0,
+		std::numeric_limits<double>::max(), 0.001, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propTimeGrid("timeGrid", "Grid Lines (ms)", 0.0, 0.0, std::numeric_limits<double>::max(),
+		0.001, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propTimeMesh("timeMesh", "Mesh Assembly (ms)", 0.0, 0.0, std::numeric_limits<double>::max(),
+		0.001, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propTimeUpload("timeUpload", "Mesh Upload (ms)", 0.0, 0.0, std::numeric_limits<double>::max(),
+		0.001, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propTimeTotal("timeTotal", "Total (ms)", 0.0, 0.0, std::numeric_limits<double>::max(),
+		0.001, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propTimeSimplification("timeSimplification", "Simplification (ms)", 0.0, 0.0,
+		std::numeric_limits<double>::max(), 0.001, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propCellsScanned("cellsScanned", "Cells Scanned", 0, 0, std::numeric_limits<size_t>::max(),
+		1, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propActiveCells("activeCells", "Active Cells", 0, 0, std::numeric_limits<size_t>::max(),
+		1, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propAmbiguousAbove("ambiguousAbove", "Ambiguous, Joined Above", 0, 0,
+		std::numeric_limits<size_t>::max(), 1, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propAmbiguousBelow("ambiguousBelow", "Ambiguous, Joined Below", 0, 0,
+		std::numeric_limits<size_t>::max(), 1, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propSegments("segments", "Segments", 0, 0, std::numeric_limits<size_t>::max(),
+		1, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propVertices("vertices", "Vertices", 0, 0, std::numeric_limits<size_t>::max(),
+		1, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propBytesAllocated("bytesAllocated", "Bytes Allocated", 0, 0, std::numeric_limits<size_t>::max(),
+		1, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propVerticesBeforeSimplification("verticesBeforeSimplification", "Vertices Before Simplification",
+		0, 0, std::numeric_limits<size_t>::max(), 1, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propVerticesAfterSimplification("verticesAfterSimplification", "Vertices After Simplification",
+		0, 0, std::numeric_limits<size_t>::max(), 1, InvalidationLevel::Valid, PropertySemantics::Text)
+	, propChangedBlocks("changedBlocks", "Changed Blocks", 0, 0, std::numeric_limits<size_t>::max(),
+		1, InvalidationLevel::Valid, PropertySemantics::Text)
+#endif
+	, filter_(propSigma.get())
 {
     // Register ports
     addPort(inData);
@@ -56,11 +234,30 @@ MarchingSquares::MarchingSquares()
     // Register properties
     addProperty(propShowGrid);
     addProperty(propGridColor);
+    addProperty(propGridLod);
+    addProperty(propGridSpacing);
 	
     addProperty(propDeciderType);
     propDeciderType.addOption("midpoint", "Mid Point", 0);
     propDeciderType.addOption("asymptotic", "Asymptotic", 1);
 
+    addProperty(propExtraction);
+    propExtraction.addOption("segments", "Line Segments", 0);
+    propExtraction.addOption("polylines", "Shared Vertex Polylines", 1);
+    propExtraction.addOption("following", "Contour Following", 2);
+
+    addProperty(propSimplification);
+    propSimplification.addOption("none", "None", static_cast<int>(contouring::Simplification::None));
+    propSimplification.addOption("douglasPeucker", "Douglas-Peucker",
+        static_cast<int>(contouring::Simplification::DouglasPeucker));
+    propSimplification.addOption("visvalingam", "Visvalingam-Whyatt",
+        static_cast<int>(contouring::Simplification::Visvalingam));
+    addProperty(propSimplifyTolerance);
+
+    addProperty(propMeshFormat);
+    propMeshFormat.addOption("full", "Full Vertices", 0);
+    propMeshFormat.addOption("isovalues", "Positions and Isovalues", 1);
+
     addProperty(propMultiple);
     
     propMultiple.addOption("single", "Single", 0);
@@ -70,6 +267,7 @@ MarchingSquares::MarchingSquares()
     propMultiple.addOption("multiple", "Multiple", 1);
     addProperty(propNumContours);
     addProperty(propIsoTransferFunc);
+    addProperty(propBands);
 
     // The default transfer function has just two blue points
     /*propIsoTransferFunc.get().clearPoints();
@@ -88,22 +286,74 @@ MarchingSquares::MarchingSquares()
 
 	addProperty(propApplyGaussian);
 	addProperty(propSigma);
+	addProperty(propSlices);
+	propSlices.addOption("first", "First Slice", 0);
+	propSlices.addOption("range", "Slice Range", 1);
+	addProperty(propSliceRange);
+	addProperty(propThreads);
+	addProperty(propBackground);
+	addProperty(propPreviewStride);
+	addProperty(propTemporalCoherence);
+	addProperty(propWorkingCopy);
+
+	// The file is read tile by tile, the inport is not used while streaming
+	inData.setOptional(true);
+	addProperty(propStreaming);
+	propStreaming.addProperty(propStreamEnable);
+	propStreaming.addProperty(propStreamFile);
+	propStreaming.addProperty(propStreamDims);
+	propStreaming.addProperty(propStreamType);
+	propStreamType.addOption("int8", "Int8", static_cast<int>(contouring::RawType::Int8));
+	propStreamType.addOption("uint8", "UInt8", static_cast<int>(contouring::RawType::UInt8));
+	propStreamType.addOption("int16", "Int16", static_cast<int>(contouring::RawType::Int16));
+	propStreamType.addOption("uint16", "UInt16", static_cast<int>(contouring::RawType::UInt16));
+	propStreamType.addOption("int32", "Int32", static_cast<int>(contouring::RawType::Int32));
+	propStreamType.addOption("uint32", "UInt32", static_cast<int>(contouring::RawType::UInt32));
+	propStreamType.addOption("float32", "Float32", static_cast<int>(contouring::RawType::Float32));
+	propStreamType.addOption("float64", "Float64", static_cast<int>(contouring::RawType::Float64));
+	propStreamType.setSelectedValue(static_cast<int>(contouring::RawType::Float32));
+	propStreaming.addProperty(propStreamOffset);
+	propStreaming.addProperty(propStreamTileSize);
+
+#if LABMARCHINGSQUARES_PROFILING
+	// The statistics are results of the last run, they are neither edited nor saved
+	addProperty(propStatistics);
+	propStatistics.addProperty(propStatisticsLog);
+	for (Property* prop : std::initializer_list<Property*>{ &propTimeFilter, &propTimePyramid,
+		&propTimeExtraction, &propTimeGrid, &propTimeMesh, &propTimeUpload, &propTimeTotal,
+		&propCellsScanned, &propActiveCells, &propAmbiguousAbove, &propAmbiguousBelow, &propSegments,
+		&propVertices, &propBytesAllocated, &propTimeSimplification, &propVerticesBeforeSimplification,
+		&propVerticesAfterSimplification, &propChangedBlocks })
+	{
+		prop->setReadOnly(true);
+		prop->setSerializationMode(PropertySerializationMode::None);
+		propStatistics.addProperty(*prop);
+	}
+#endif
 
-    util::hide(propGridColor, propNumContours, propIsoTransferFunc, propSigma);
+    util::hide(propGridColor, propGridLod, propGridSpacing, propNumContours, propIsoTransferFunc, propBands,
+        propSigma, propSliceRange, propSimplifyTolerance, propPreviewStride);
 
     // Show the grid color property only if grid is actually displayed
     propShowGrid.onChange([this]()
     {
         if (propShowGrid.get())
         {
-            util::show(propGridColor);
+            util::show(propGridColor, propGridLod);
+            propGridSpacing.setVisible(propGridLod.get());
         }
         else
         {
-            util::hide(propGridColor);
+            util::hide(propGridColor, propGridLod, propGridSpacing);
         }
     });
 
+    // The minimum spacing only matters when lines are left out
+    propGridLod.onChange([this]()
+    {
+        propGridSpacing.setVisible(propShowGrid.get() && propGridLod.get());
+    });
+
 	// Show the sigma property only if Gaussian Filter is actually applied
 	propApplyGaussian.onChange([this]()
 	{
@@ -117,13 +367,31 @@ MarchingSquares::MarchingSquares()
 		}
 	});
 
+	// Show the slice range only if it is used
+	propSlices.onChange([this]()
+	{
+		propSliceRange.setVisible(propSlices.get() == 1);
+	});
+
+	// Show the preview stride only if there is a preview
+	propBackground.onChange([this]()
+	{
+		propPreviewStride.setVisible(propBackground.get());
+	});
+
+	// Show the tolerance only if polylines are simplified
+	propSimplification.onChange([this]()
+	{
+		propSimplifyTolerance.setVisible(propSimplification.get() != 0);
+	});
+
     // Show options based on display of one or multiple iso contours
     propMultiple.onChange([this]()
     {
         if (propMultiple.get() == 0)
         {
             util::show(propIsoValue, propIsoColor);
-            util::hide(propNumContours, propIsoTransferFunc);
+            util::hide(propNumContours, propIsoTransferFunc, propBands);
         }
         else
         {
@@ -133,13 +401,97 @@ MarchingSquares::MarchingSquares()
             // TODO (Bonus): Comment out above if you are using the transfer function
             // and comment in below instead
             util::hide(propIsoValue, propIsoColor);
-            util::show(propNumContours, propIsoTransferFunc);
+            util::show(propNumContours, propIsoTransferFunc, propBands);
         }
     });
 
 }
 
+MarchingSquares::~MarchingSquares()
+{
+	// The background extraction works on the caches, it has to stop before they go away
+	if (job_)
+	{
+		job_->orphaned = true;
+		job_->cancel = true;
+		jobTask_.wait();
+	}
+}
+
 void MarchingSquares::process()
+{
+	profile_ = Profile();
+	// The statistics of the last run stay shown while the background extraction is busy
+	if (!pollBackgroundJob()) return;
+	{
+		contouring::StageTimer timer(profile_.total);
+		// A raw file can be streamed instead of the volume on the inport
+		if (propStreamEnable.get())
+		{
+			processStreaming();
+		}
+		else
+		{
+			streamSource_.reset();
+			processVolume();
+		}
+	}
+	publishProfile();
+}
+
+int MarchingSquares::extractionMode() const
+{
+	return propExtraction.get() == 0 && propSimplification.get() != 0 ? 1 : propExtraction.get();
+}
+
+bool MarchingSquares::temporalCoherence() const
+{
+	// Contour following has no pieces, and a streamed file is read anew anyway
+	return propTemporalCoherence.get() && !propStreamEnable.get() && extractionMode() != 2;
+}
+
+MarchingSquares::ExtractionState MarchingSquares::extractionState() const
+{
+	ExtractionState state;
+	state.smoothed = propApplyGaussian.get();
+	state.sigma = propSigma.get();
+	state.temporal = temporalCoherence();
+	// A new frame in temporal coherence mode updates the caches from the volume itself
+	state.workingCopy = propWorkingCopy.get() && !state.temporal;
+	state.decider = static_cast<contouring::Decider>(propDeciderType.get());
+	state.extraction = static_cast<contouring::Extraction>(extractionMode());
+	state.numThreads = static_cast<size_t>(propThreads.get());
+	return state;
+}
+
+bool MarchingSquares::ExtractionState::operator==(const ExtractionState& other) const
+{
+	// Sigma is not used without smoothing
+	if (smoothed && sigma != other.sigma) return false;
+	return std::tie(smoothed, temporal, workingCopy, decider, extraction, numThreads) ==
+		std::tie(other.smoothed, other.temporal, other.workingCopy, other.decider, other.extraction,
+			other.numThreads);
+}
+
+void MarchingSquares::selectSlices(const size3_t& dims, size_t& zBegin, size_t& zEnd) const
+{
+	zBegin = 0;
+	zEnd = 1;
+	if (propSlices.get() == 1)
+	{
+		const ivec2 range = propSliceRange.get();
+		zEnd = std::min<size_t>(std::max(range.x, range.y), dims.z - 1) + 1;
+		zBegin = std::min<size_t>(std::max(std::min(range.x, range.y), 0), zEnd - 1);
+	}
+}
+
+bool MarchingSquares::showBands() const
+{
+	// The bands lie between the multiple contours, a streamed file has no slice cache to keep them
+	return propBands.get() && propMultiple.get() == 1 && !propStreamEnable.get();
+}
+
+void MarchingSquares::processVolume()
 {
     if (!inData.hasData()) {
 	    return;
@@ -170,17 +522,12 @@ void MarchingSquares::process()
     const VolumeRAM* vr = vol->getRepresentation< VolumeRAM >();
     const size3_t dims = vol->getDimensions();
 
-    // Initialize mesh and vertices
-    auto mesh = std::make_shared<BasicMesh>();
-    std::vector<BasicMesh::Vertex> vertices;
-
-    // Values within the input data are accessed by the function below
-    // It's input is the VolumeRAM from above, the dimensions of the volume
-    // and the indeces i and j of the position to be accessed where
-    // i is in [0, dims.x-1] and j is in [0, dims.y-1]
-    // float valueat00 = getInputValue(vr, dims, 0, 0);
-    // LogProcessorInfo("Value at (0,0) is: " << valueat00);
+    // Values within the input data are accessed through a typed view of the 0th slice,
+    // see dispatchScalarField below. Its call operator takes the indices i and j of
+    // the position to be accessed where i is in [0, dims.x-1] and j is in [0, dims.y-1]
+    // float valueat00 = field(0, 0);
     // You can assume that dims.z = 1 and do not need to consider others cases
+    // (unless contours are extracted from a range of slices, see propSlices)
 
     // TODO (Bonus) Gaussian filter
     // Our input is const, but you need to compute smoothed data and write it somewhere
@@ -189,63 +536,454 @@ void MarchingSquares::process()
     // auto vrSmoothed = volSmoothed.getEditableRepresentation<VolumeRAM>();
     // Values can be set with
     // vrSmoothed->setFromDouble(vec3(i,j,0), value);
-    // getting values works with an editable volume as well
-    // getInputValue(vrSmoothed, dims, 0, 0);
 
 	
 	// GAUSSIAN FILTER
 
-	Volume volSmoothed(vol->getDimensions(), vol->getDataFormat());
-	auto vrSmoothed = volSmoothed.getEditableRepresentation<VolumeRAM>();
-	
-	const int radius = 3; // radius x radius of neighbours to calculate gaussian smoothing
-	float sigma = propSigma.get(); // Default value => 0.5f
+	// Only the processed slices are smoothed, they are kept as floats (see gaussianSmoothing)
 
-	const VolumeRAM* myVolume = propApplyGaussian.get() ?  gaussianSmoothing(vr, vrSmoothed, dims, sigma, radius) : vr;
+	// Slices [zBegin, zEnd) are processed
+	propSliceRange.setRangeMax(static_cast<int>(dims.z) - 1);
+	size_t zBegin = 0;
+	size_t zEnd = 1;
+	selectSlices(dims, zBegin, zEnd);
 
+	// Every stage keeps its result and is only redone when the inputs it depends
+	// on change. The slice caches (smoothed slice, pyramid and contours) belong to
+	// the input volume, the processed slices and the filter settings.
+	const bool smoothed = propApplyGaussian.get();
+	const float sigma = propSigma.get();
+	const bool dataChanged = inData.isChanged() || fieldVolume_.lock() != vol;
+	const bool settingsChanged = fieldSmoothed_ != smoothed || (smoothed && fieldSigma_ != sigma) ||
+		sliceBegin_ != zBegin || slices_.size() != zEnd - zBegin;
 
-    // Grid
+	// In temporal coherence mode a new frame of the same size only updates the caches
+	// where it differs from the last one, if they were made the same way
+	bool updated = false;
+	if (dataChanged && !settingsChanged && temporalCoherence() && fieldDims_ == dims &&
+		!slices_.front().previous.empty() && levelsTemporal_ &&
+		levelsDecider_ == propDeciderType.get() && levelsExtraction_ == extractionMode())
+	{
+		std::vector<float> converted;
+		dispatchScalarField(vr, dims, zBegin, zEnd, converted, [&](const auto& first)
+		{
+			updated = this->updateSlices(first);
+		});
+		fieldVolume_ = vol;
+		meshValid_ = false;
+	}
+	if (!updated && (dataChanged || settingsChanged))
+	{
+		fieldVolume_ = vol;
+		fieldDims_ = dims;
+		fieldSmoothed_ = smoothed;
+		fieldSigma_ = sigma;
+		sliceBegin_ = zBegin;
+		slices_.clear();
+		slices_.resize(zEnd - zBegin);
+		meshValid_ = false;
+	}
+	updateContours(dims, [&](const std::vector<double>& isoValues, const std::vector<double>& missing,
+		const std::vector<double>& bandIsoValues)
+	{
+		// The kernel only has to be recomputed when sigma changes
+		if (smoothed && filter_.getSigma() != sigma)
+		{
+			filter_ = contouring::GaussianFilter(sigma);
+		}
+		if (propBackground.get())
+		{
+			startBackgroundJob(vol, dims, zBegin, zEnd, isoValues, missing, bandIsoValues);
+			return false;
+		}
 
-    // Properties are accessed with propertyName.get() 
-    if (propShowGrid.get())
-    {
-        // TODO: Add grid lines of the given color 
+		// The data format is resolved once here, everything below runs on typed memory
+		std::vector<float> converted;
+		dispatchScalarField(vr, dims, zBegin, zEnd, converted, [&](const auto& first)
+		{
+			this->extractSlices(first, missing.data(), missing.data() + missing.size(), bandIsoValues,
+				extractionState(), profile_);
+		});
+		return true;
+	});
+}
 
-        // The function drawLineSegments creates two vertices at the specified positions, 
-        // that are placed into the Vertex vector defining our mesh. 
-        // An index buffer specifies which of those vertices should be grouped into to make up lines/trianges/quads.
-        // Here two vertices make up a line segment.
-        auto indexBufferGrid = mesh->addIndexBuffer(DrawType::Lines, ConnectivityType::None);
+bool MarchingSquares::pollBackgroundJob()
+{
+	if (!job_) return true;
 
-        // Draw a line segment from v1 to v2 with a color, the coordinates in the final 
-        // image range from 0 to 1 for both x and y
-        //vec2 v1 = vec2(0.5, 0.5);
-        //vec2 v2 = vec2(0.7, 0.7);
-        //drawLineSegment(v1, v2, propGridColor.get(), indexBufferGrid, vertices);
+	if (job_->done)
+	{
+		// The run that picks up the result shows the statistics of the job
+		profile_ += job_->profile;
+		if (!job_->error.empty())
+		{
+			LogProcessorError("Background extraction failed: " << job_->error);
+		}
+		// A cancelled or failed job may have left out slices, its levels are extracted again
+		if (job_->cancel || !job_->error.empty())
+		{
+			for (auto& slice : slices_)
+			{
+				for (const double isoValue : job_->missing)
+				{
+					const auto it = slice.levels.find(isoValue);
+					if (it == slice.levels.end()) continue;
+					slice.spareLevels.push_back(std::move(it->second));
+					slice.levels.erase(it);
+				}
+			}
+		}
+		jobTask_.wait();
+		job_.reset();
+		return true;
+	}
+
+	// Any change of what the job extracts makes its result stale
+	std::vector<double> isoValues;
+	std::vector<vec4> isoColors;
+	std::vector<vec4> bandColors;
+	collectIsovalues(isoValues, isoColors);
+	collectBandColors(isoValues, bandColors);
+	size_t zBegin = 0;
+	size_t zEnd = 0;
+	selectSlices(job_->dims, zBegin, zEnd);
+	if (propStreamEnable.get() || !inData.hasData() || inData.getData() != job_->volume.lock() ||
+		!(extractionState() == job_->state) || showBands() != job_->bands || zBegin != job_->zBegin ||
+		zEnd != job_->zEnd || isoValues != job_->isoValues)
+	{
+		job_->cancel = true;
+		return false;
+	}
+
+	// The preview takes the place of the mesh until the contours of the full field are there
+	if (job_->previewReady && !job_->previewShown)
+	{
+		updateGrid(job_->dims);
+		assembleMesh(job_->dims, isoValues, isoColors, bandColors, job_->preview);
+		meshValid_ = false;
+		meshOut.setData(buildMesh());
+		job_->previewShown = true;
+	}
+	return false;
+}
+
+void MarchingSquares::startBackgroundJob(const std::shared_ptr<const Volume>& vol, const size3_t& dims,
+	size_t zBegin, size_t zEnd, const std::vector<double>& isoValues, const std::vector<double>& missing,
+	const std::vector<double>& bandIsoValues)
+{
+	auto job = std::make_shared<BackgroundJob>();
+	job->volume = vol;
+	job->dims = dims;
+	job->zBegin = zBegin;
+	job->zEnd = zEnd;
+	job->state = extractionState();
+	job->isoValues = isoValues;
+	job->missing = missing;
+	job->bandIsoValues = bandIsoValues;
+	job->bands = showBands();
+	job->previewStride = static_cast<size_t>(propPreviewStride.get());
+	job_ = job;
+
+	// The job holds on to the volume, its representation is only read there. Until the
+	// job is done the main thread leaves the caches and the filter alone (see pollBackgroundJob).
+	const VolumeRAM* vr = vol->getRepresentation<VolumeRAM>();
+	jobTask_ = dispatchPool([this, job, vol, vr]()
+	{
+		try
+		{
+			std::vector<float> converted;
+			dispatchScalarField(vr, job->dims, job->zBegin, job->zEnd, converted, [&](const auto& first)
+			{
+				if (job->previewStride > 1)
+				{
+					this->extractPreview(first, *job);
+					if (!job->cancel)
+					{
+						dispatchFront([this, job]()
+						{
+							if (job->orphaned) return;
+							job->previewReady = true;
+							this->invalidate(InvalidationLevel::InvalidOutput);
+						});
+					}
+				}
+				const double* begin = job->missing.data();
+				this->extractSlices(first, begin, begin + job->missing.size(), job->bandIsoValues, job->state,
+					job->profile, &job->cancel);
+			});
+		}
+		catch (const std::exception& e)
+		{
+			job->error = e.what();
+		}
+		catch (...)
+		{
+			job->error = "unknown exception";
+		}
+
+		dispatchFront([this, job]()
+		{
+			if (job->orphaned) return;
+			job->done = true;
+			this->invalidate(InvalidationLevel::InvalidOutput);
+		});
+	});
+}
+
+template <typename T>
+void MarchingSquares::extractPreview(const contouring::FieldView<T>& first, BackgroundJob& job)
+{
+	contouring::ContouringSettings settings;
+	settings.decider = job.state.decider;
+	settings.extraction = job.state.extraction;
+	settings.numThreads = job.state.numThreads;
+	settings.cancel = &job.cancel;
+	const double* begin = job.isoValues.data();
+	const double* end = begin + job.isoValues.size();
+	const bool segments = settings.extraction == contouring::Extraction::Segments;
+
+	std::vector<float> values;
+	job.preview.resize(job.zEnd - job.zBegin);
+	for (size_t s = 0; s < job.preview.size() && !job.cancel; s++)
+	{
+		// A smoothed slice is used if it is there already, the preview does not wait for the filter
+		const auto field = sliceAfter(first, s);
+		const auto& smoothed = slices_[s].smoothed;
+		const contouring::FieldView<float> coarse = job.state.smoothed && smoothed.size() == field.nx * field.ny ?
+			contouring::subsampleField(contouring::FieldView<float>(smoothed.data(), field.nx, field.ny),
+				job.previewStride, values) :
+			contouring::subsampleField(field, job.previewStride, values);
+		const vec2 scale(field.nx > 1 ? static_cast<float>((coarse.nx - 1) * job.previewStride) / (field.nx - 1) : 1.0f,
+			field.ny > 1 ? static_cast<float>((coarse.ny - 1) * job.previewStride) / (field.ny - 1) : 1.0f);
 
-		for (size_t i = 0; i < dims.x; i++)
+		SliceCache& preview = job.preview[s];
+		contouring::ContourLevels levels;
+		contouring::ContouringStats stats;
+		contouring::extractContours(coarse, begin, end, settings, preview.acceleration, levels, stats);
+		for (size_t level = 0; level < job.isoValues.size(); level++)
 		{
-			float ix = 1.0 / (dims.x - 1) * i;
-			drawLineSegment(vec2(ix, 0), vec2(ix, 1), propGridColor.get(), indexBufferGrid, vertices);
+			LevelGeometry& geometry = preview.levels[begin[level]];
+			if (segments)
+			{
+				std::swap(geometry.segments, levels.segments[level]);
+				scalePoints(geometry.segments, scale);
+			}
+			else
+			{
+				std::swap(geometry.contour, levels.contours[level]);
+				scalePoints(geometry.contour.vertices, scale);
+			}
 		}
+		if (job.bands)
+		{
+			contouring::extractIsobands(coarse, begin, end, settings.decider, preview.bands, settings.numThreads,
+				nullptr, &job.cancel);
+			for (auto& band : preview.bands)
+			{
+				scalePoints(band.vertices, scale);
+			}
+		}
+	}
+}
 
-		for (size_t j = 0; j < dims.y; j++)
+void MarchingSquares::processStreaming()
+{
+	// The caches belong to the file, its layout and the filter settings
+	const bool smoothed = propApplyGaussian.get();
+	const float sigma = propSigma.get();
+	const ivec2 size = propStreamDims.get();
+	if (!streamSource_ || streamFile_ != propStreamFile.get() || streamDims_ != size ||
+		streamType_ != propStreamType.get() || streamOffset_ != propStreamOffset.get() ||
+		fieldSmoothed_ != smoothed || (smoothed && fieldSigma_ != sigma))
+	{
+		streamSource_.reset();
+		fieldVolume_.reset();
+		fieldSmoothed_ = smoothed;
+		fieldSigma_ = sigma;
+		sliceBegin_ = 0;
+		slices_.clear();
+		slices_.resize(1);
+		meshValid_ = false;
+
+		try
 		{
-			float iy = 1.0 / (dims.y - 1) * j;
-			drawLineSegment(vec2(0, iy), vec2(1, iy), propGridColor.get(), indexBufferGrid, vertices);
+			streamSource_ = std::make_unique<contouring::RawFieldSource>(propStreamFile.get(),
+				static_cast<contouring::RawType>(propStreamType.get()), std::max(size.x, 0),
+				std::max(size.y, 0), propStreamOffset.get());
+			// One pass over the file for the range of the isovalue
+			streamRange_ = contouring::findValueRange(*streamSource_);
 		}
-		
-    }
+		catch (const std::exception& e)
+		{
+			streamSource_.reset();
+			LogProcessorError("Cannot stream the field: " << e.what());
+			return;
+		}
+		streamFile_ = propStreamFile.get();
+		streamDims_ = size;
+		streamType_ = propStreamType.get();
+		streamOffset_ = propStreamOffset.get();
+	}
 
-    // Iso contours
+	propIsoValue.setMinValue(streamRange_.x);
+	propIsoValue.setMaxValue(streamRange_.y);
 
+	const size3_t dims(streamSource_->getWidth(), streamSource_->getHeight(), 1);
+	updateContours(dims, [&](const std::vector<double>&, const std::vector<double>& missing,
+		const std::vector<double>&)
+	{
+		contouring::StreamingSettings settings;
+		settings.tileSize = static_cast<size_t>(propStreamTileSize.get());
+		settings.sigma = smoothed ? sigma : 0.0f;
+		settings.decider = static_cast<contouring::Decider>(propDeciderType.get());
+		settings.numThreads = propThreads.get();
+
+		const double* begin = missing.data();
+		const double* end = missing.data() + missing.size();
+		auto& levels = slices_[0].levels;
+		contouring::StreamingStats stats;
+		if (extractionMode() == 0)
+		{
+			std::vector<std::vector<vec2>> segments;
+			contouring::StageTimer timer(profile_.extraction);
+			stats = contouring::streamSegments(*streamSource_, begin, end, settings, segments);
+			for (size_t level = 0; level < segments.size(); level++)
+			{
+				levels[begin[level]].segments = std::move(segments[level]);
+			}
+		}
+		else
+		{
+			std::vector<contouring::ContourGeometry> contours;
+			contouring::StageTimer timer(profile_.extraction);
+			stats = contouring::streamPolylines(*streamSource_, begin, end, settings, contours);
+			for (size_t level = 0; level < contours.size(); level++)
+			{
+				levels[begin[level]].contour = std::move(contours[level]);
+			}
+		}
+
+		profile_.counters += stats.counters;
+		return true;
+	});
+}
+
+void MarchingSquares::updateContours(const size3_t& dims, const std::function<bool(const std::vector<double>&,
+	const std::vector<double>&, const std::vector<double>&)>& extractMissing)
+{
+	// The contours also depend on how they are extracted
+	if (levelsDecider_ != propDeciderType.get() || levelsExtraction_ != extractionMode() ||
+		levelsTemporal_ != temporalCoherence())
+	{
+		levelsDecider_ = propDeciderType.get();
+		levelsExtraction_ = extractionMode();
+		levelsTemporal_ = temporalCoherence();
+		for (auto& slice : slices_)
+		{
+			slice.levels.clear();
+			slice.spareLevels.clear();
+			slice.bands.clear();
+			slice.bandIsoValues.clear();
+		}
+		meshValid_ = false;
+	}
+
+	std::vector<double> isoValues;
+	std::vector<vec4> isoColors;
+	std::vector<vec4> bandColors;
+	collectIsovalues(isoValues, isoColors);
+	collectBandColors(isoValues, bandColors);
+
+	// The grid lines are cached on their own and only redone when the grid changes
+	bool gridChanged = false;
+	{
+		contouring::StageTimer timer(profile_.grid);
+		gridChanged = updateGrid(dims);
+	}
+
+	// Only a change of colors keeps the geometry of the mesh
+	const bool simplificationChanged = meshSimplification_ != propSimplification.get() ||
+		(meshSimplification_ != 0 && meshTolerance_ != propSimplifyTolerance.get());
+	if (meshValid_ && !gridChanged && meshGrid_ == propShowGrid.get() && meshIsoValues_ == isoValues &&
+		!simplificationChanged && meshBands_ == showBands())
+	{
+		contouring::StageTimer timer(profile_.mesh);
+		recolorMesh(isoColors, bandColors);
+	}
+	else
+	{
+		// Contours of isovalues that are no longer shown are dropped, new ones are
+		// extracted together in a single sweep. All slices hold the same isovalues.
+		std::vector<double> missing;
+		for (auto& slice : slices_)
+		{
+			auto& levels = slice.levels;
+			for (auto it = levels.begin(); it != levels.end();)
+			{
+				if (std::binary_search(isoValues.begin(), isoValues.end(), it->first))
+				{
+					++it;
+					continue;
+				}
+				slice.spareLevels.push_back(std::move(it->second));
+				it = levels.erase(it);
+			}
+		}
+		for (const double isoValue : isoValues)
+		{
+			if (slices_[0].levels.find(isoValue) == slices_[0].levels.end() &&
+				(missing.empty() || missing.back() != isoValue))
+			{
+				missing.push_back(isoValue);
+			}
+		}
+
+		// The bands are extracted for all isovalues at once, on the slices they are missing from
+		std::vector<double> bandIsoValues;
+		for (auto& slice : slices_)
+		{
+			if (!showBands())
+			{
+				slice.bands.clear();
+				slice.bandIsoValues.clear();
+			}
+			else if (slice.bandIsoValues != isoValues)
+			{
+				bandIsoValues = isoValues;
+			}
+		}
+
+		// The mesh is made once the contours of a background extraction are there
+		if ((!missing.empty() || !bandIsoValues.empty()) && !extractMissing(isoValues, missing, bandIsoValues))
+		{
+			return;
+		}
+
+		contouring::StageTimer timer(profile_.mesh);
+		assembleMesh(dims, isoValues, isoColors, bandColors, slices_);
+	}
+
+    // Note: It is possible to add multiple index buffers to the same mesh,
+    // thus you could for example add one for the grid lines and one for
+    // each isoline
+    // Also, consider to write helper functions to avoid code duplication
+    // e.g. for the computation of a single iso contour
+
+	// The mesh is handed out, so it is built anew from the cached positions and indices
+	contouring::StageTimer timer(profile_.upload);
+	meshOut.setData(buildMesh());
+}
+
+void MarchingSquares::collectIsovalues(std::vector<double>& isoValues, std::vector<vec4>& isoColors) const
+{
     if (propMultiple.get() == 0)
     {
         // TODO: Draw a single isoline at the specified isovalue (propIsoValue) 
         // and color it with the specified color (propIsoColor)
 
-		auto isoBufferGrid = mesh->addIndexBuffer(DrawType::Lines, ConnectivityType::None);
-		drawIsolineSingleValue(propIsoValue, propIsoColor.get(), myVolume, dims, isoBufferGrid, vertices);
+		isoValues.push_back(propIsoValue);
+		isoColors.push_back(propIsoColor.get());
     }
     else
     {
@@ -259,9 +997,9 @@ void MarchingSquares::process()
 			const double isoVal = propIsoValue.getMinValue() + (iso + 1) * w;
 			double isoValNormalized = (isoVal - propIsoValue.getMinValue()) / (propIsoValue.getMaxValue() - propIsoValue.getMinValue());
 
-			const vec4& color = propIsoTransferFunc.get().sample(isoValNormalized);
-
-			drawIsolineSingleValue(isoVal, color, myVolume, dims, mesh->addIndexBuffer(DrawType::Lines, ConnectivityType::None), vertices);
+			// The transfer function is sampled once per level
+			isoValues.push_back(isoVal);
+			isoColors.push_back(propIsoTransferFunc.get().sample(isoValNormalized));
 		}
         
         // TODO (Bonus): Use the transfer function property to assign a color
@@ -273,176 +1011,828 @@ void MarchingSquares::process()
         // is the color for the maximum value in the data
 
     }
+}
 
-    // Note: It is possible to add multiple index buffers to the same mesh,
-    // thus you could for example add one for the grid lines and one for
-    // each isoline
-    // Also, consider to write helper functions to avoid code duplication
-    // e.g. for the computation of a single iso contour
+void MarchingSquares::collectBandColors(const std::vector<double>& isoValues,
+	std::vector<vec4>& bandColors) const
+{
+	if (!showBands()) return;
 
-    mesh->addVertices(vertices);
-    meshOut.setData(mesh);
+	// Every band is colored like the value in its middle
+	const double minValue = propIsoValue.getMinValue();
+	const double range = propIsoValue.getMaxValue() - minValue;
+	for (size_t k = 0; k <= isoValues.size(); k++)
+	{
+		const double value = bandMidValue(isoValues, k, minValue, propIsoValue.getMaxValue());
+		bandColors.push_back(propIsoTransferFunc.get().sample(range > 0.0 ? (value - minValue) / range : 0.0));
+	}
 }
 
-VolumeRAM* MarchingSquares::gaussianSmoothing(const VolumeRAM* vr, VolumeRAM* vrSmoothed, const size3_t dims, float sigma, const int radius)
+template <typename T>
+void MarchingSquares::extractSlices(const contouring::FieldView<T>& first, const double* begin,
+	const double* end, const std::vector<double>& bandIsoValues, const ExtractionState& state, Profile& profile,
+	const std::atomic<bool>* cancel)
 {
-	// for every cell
-	for (int x = 0; x < dims.x; x++) {
-		for (int y = 0; y < dims.y; y++) {
-
-			double total = 0.0;
-			double totalFilter = 0.0;
+	// Several slices are processed in parallel with one thread each, a single
+	// slice uses all threads itself
+	const size_t numSlices = slices_.size();
+	const size_t threads = numSlices > 1 ? state.numThreads : 1;
+	const size_t sliceThreads = numSlices > 1 ? 1 : state.numThreads;
 
-			// apply filter , but consider dimension boundaries
-			int startX = (x - radius < 0) ? 0 : x - radius;
-			int endX = (x + radius > dims.x - 1) ? dims.x - 1 : x + radius;
-			int startY = (y - radius < 0) ? 0 : y - radius;
-			int endY = (y + radius > dims.y - 1) ? dims.y - 1 : y + radius;
+	std::vector<contouring::GaussianFilterStats> stats(numSlices);
+	std::vector<Profile> profiles(numSlices);
+	contouring::parallelForEach(numSlices, threads, [&](size_t s, size_t)
+	{
+		if (contouring::isCancelled(cancel)) return;
+		SliceCache& slice = slices_[s];
+		const auto field = sliceAfter(first, s);
+		// The next frame is compared with the samples the caches are made from
+		if (state.temporal && slice.previous.empty())
+		{
+			contouring::gatherField(field, slice.previous);
+		}
 
-			// TODO: Not very nice, as we do not save values and recalculate for every cell.. (should do DYNAMIC PROGRAMMING)
-			for (int i = startX; i <= endX; i++) {
-				for (int j = startY; j <= endY; j++) {
-					// Calculate kernel-value by applying gaussian(x,y) centered at current cell
-					double filterVal = gaussian(i - x, j - y, sigma);
-					totalFilter += filterVal;
-					total += getInputValue(vr, dims, i, j) * filterVal;
+		// Contours and bands are extracted from the same field
+		auto extract = [&](const auto& source)
+		{
+			if (contouring::isCancelled(cancel)) return;
+			if (begin != end)
+			{
+				this->extractLevels(source, slice, begin, end, state, sliceThreads, profiles[s], cancel);
+			}
+			if (!bandIsoValues.empty() && slice.bandIsoValues != bandIsoValues)
+			{
+				contouring::StageTimer timer(profiles[s].extraction);
+				contouring::extractIsobands(source, bandIsoValues.data(),
+					bandIsoValues.data() + bandIsoValues.size(), state.decider, slice.bands, sliceThreads,
+					&profiles[s].counters, cancel);
+				// Cancelled bands are empty, the next run extracts them again
+				if (contouring::isCancelled(cancel))
+				{
+					slice.bandIsoValues.clear();
 				}
+				else
+				{
+					slice.bandIsoValues = bandIsoValues;
+				}
+			}
+		};
+		if (state.smoothed)
+		{
+			const auto smoothed = this->gaussianSmoothing(field, slice, sliceThreads, stats[s], cancel);
+			if (!stats[s].cancelled) extract(smoothed);
+			return;
+		}
+		// The copy is made once per input, the pyramid and seeds are built from it
+		if (state.workingCopy && !slice.workingBuilt)
+		{
+			contouring::StageTimer timer(profiles[s].pyramid);
+			slice.working.build(field);
+			slice.workingBuilt = true;
+			profiles[s].counters.countBytes(slice.working.getByteSize());
+		}
+		if (!state.workingCopy || !slice.working.dispatch(extract))
+		{
+			extract(field);
+		}
+	});
+	for (const auto& sliceProfile : profiles)
+	{
+		profile += sliceProfile;
+	}
+
+	// The filter time is summed over all slices it ran on
+	for (size_t s = 0; s < numSlices; s++)
+	{
+		if (stats[s].threads == 0) continue;
+		profile.filter += stats[s].milliseconds;
+		// The filter input is gathered into a temporary buffer of the same size
+		profile.counters.countBytes(2 * contouring::vectorBytes(slices_[s].smoothed));
+	}
+}
+
+template <typename T>
+void MarchingSquares::extractLevels(const contouring::FieldView<T>& field, SliceCache& slice,
+	const double* begin, const double* end, const ExtractionState& state, size_t numThreads, Profile& profile,
+	const std::atomic<bool>* cancel)
+{
+	contouring::ContouringSettings settings;
+	settings.decider = state.decider;
+	settings.extraction = state.extraction;
+	settings.numThreads = numThreads;
+	settings.cancel = cancel;
+
+	// In temporal coherence mode the new levels are extracted as pieces, all of them at first
+	if (state.temporal)
+	{
+		auto& pyramid = slice.acceleration.pyramid;
+		if (pyramid.empty())
+		{
+			contouring::StageTimer timer(profile.pyramid);
+			pyramid.build(field, numThreads);
+			profile.counters.countBytes(pyramid.getByteSize());
+		}
+		for (const double* c = begin; c != end; ++c)
+		{
+			LevelGeometry& geometry = slice.levels[*c];
+			if (!slice.spareLevels.empty())
+			{
+				geometry = std::move(slice.spareLevels.back());
+				slice.spareLevels.pop_back();
 			}
-			// Divide by total number of cells we include to get average
-			vrSmoothed->setFromDouble(vec3(x, y, 0), total / totalFilter * 1.0);
+		}
+		const std::vector<std::uint8_t> dirty(contouring::numContourPieces(settings.extraction,
+			field.nx - 1, field.ny - 1), 1);
+		extractPieces(field, slice, begin, end, dirty, state, numThreads, profile, cancel);
+		return;
+	}
+
+	// Building the seeds for contour following is reported as pyramid time
+	auto& levels = slice.extracted;
+	contouring::ContouringStats stats;
+	contouring::extractContours(field, begin, end, settings, slice.acceleration, levels, stats,
+		&slice.workspace);
+	profile.pyramid += stats.acceleration;
+	profile.extraction += stats.extraction;
+	profile.counters += stats.counters;
+	// A cancelled extraction is incomplete, its levels are not cached
+	if (contouring::isCancelled(cancel)) return;
 
-			//LogProcessorInfo("Previous " << getInputValue(vr, dims, x, y) << " Smoothed " << getInputValue(vrSmoothed, dims, x, y) << " Applied " << total / totalFilter << "  "
-			//	<< (endX - startX)*(endY - startY));
+	// The extracted geometry is swapped into the cache, and the memory of a dropped
+	// level takes its place for the next extraction
+	const bool segments = settings.extraction == contouring::Extraction::Segments;
+	for (size_t level = 0; level < static_cast<size_t>(end - begin); level++)
+	{
+		LevelGeometry& geometry = slice.levels[begin[level]];
+		if (!slice.spareLevels.empty())
+		{
+			geometry = std::move(slice.spareLevels.back());
+			slice.spareLevels.pop_back();
+		}
+		if (segments)
+		{
+			std::swap(geometry.segments, levels.segments[level]);
+		}
+		else
+		{
+			std::swap(geometry.contour, levels.contours[level]);
 		}
 	}
-	return vrSmoothed;
 }
 
-void MarchingSquares::drawIsolineSingleValue(const double c, const vec4& color, const VolumeRAM* vr, const size3_t dims, IndexBufferRAM* isoBufferGrid,
-	std::vector<BasicMesh::Vertex>& vertices)
+template <typename T>
+bool MarchingSquares::updateSlices(const contouring::FieldView<T>& first)
 {
-	for (float ix = 0; ix < (dims.x - 1); ix++)
+	const ExtractionState state = extractionState();
+	const bool smoothed = state.smoothed;
+	const auto extraction = state.extraction;
+	const size_t blockSize = contouring::MinMaxPyramid::blockSize;
+	const size_t nx = first.nx;
+	const size_t ny = first.ny;
+	const size_t numBlocks = ((nx + blockSize - 1) / blockSize) * ((ny + blockSize - 1) / blockSize);
+
+	// Like extractSlices, several slices are updated in parallel with one thread each
+	const size_t numSlices = slices_.size();
+	const size_t threads = numSlices > 1 ? state.numThreads : 1;
+	const size_t sliceThreads = numSlices > 1 ? 1 : state.numThreads;
+
+	std::vector<std::uint8_t> rebuild(numSlices, 0);
+	std::vector<Profile> profiles(numSlices);
+	contouring::parallelForEach(numSlices, threads, [&](size_t s, size_t)
 	{
-		for (float iy = 0; iy < (dims.y - 1); iy++)
+		SliceCache& slice = slices_[s];
+		Profile& profile = profiles[s];
+		const auto field = sliceAfter(first, s);
+		if (slice.previous.size() != nx * ny || (smoothed && slice.smoothed.size() != nx * ny))
+		{
+			rebuild[s] = 1;
+			return;
+		}
+
+		std::vector<contouring::Region> changed;
 		{
-			float f00 = getInputValue(vr, dims, ix, iy);
-			float f01 = getInputValue(vr, dims, ix, iy + 1);
-			float f11 = getInputValue(vr, dims, ix + 1, iy + 1);
-			float f10 = getInputValue(vr, dims, ix + 1, iy);
+			contouring::StageTimer timer(profile.filter);
+			profile.changedBlocks = contouring::diffField(field, slice.previous, changed, sliceThreads);
+		}
+		if (profile.changedBlocks == 0) return;
+		// Beyond that a full run does less work than updating the pieces
+		if (2 * profile.changedBlocks > numBlocks)
+		{
+			rebuild[s] = 1;
+			return;
+		}
+		// The bands have no pieces, they are extracted again in full by extractSlices
+		slice.bandIsoValues.clear();
+		// The working copy of the last frame is out of date
+		slice.working.clear();
+		slice.workingBuilt = false;
 
-			float fmin = std::min({ f00, f01, f10, f11 });
-			float fmax = std::max({ f00, f01, f10, f11 });
-			if (fmin < c && fmax > c) // There is a isoline in this cell
+		// Smoothed samples change within the kernel radius of a changed sample, and
+		// every cell with such a corner sample has to be extracted again
+		const contouring::FieldView<float> smoothedField(slice.smoothed.data(), nx, ny);
+		auto& pyramid = slice.acceleration.pyramid;
+		std::vector<std::uint8_t> dirty(contouring::numContourPieces(extraction, nx - 1, ny - 1), 0);
+		for (const auto& region : changed)
+		{
+			contouring::Region samples = region;
+			if (smoothed)
+			{
+				samples = contouring::dilateRegion(region, filter_.getRadius(), nx, ny);
+				contouring::StageTimer timer(profile.filter);
+				filter_.applyRegion(slice.previous.data(), slice.smoothed.data(), nx, ny, samples.x0,
+					samples.y0, samples.x1, samples.y1, sliceThreads, &slice.filterScratch.rowPass);
+			}
+
+			const contouring::Region cells = contouring::cellsTouching(samples, nx, ny);
 			{
-				drawSingleIsoline(ix, iy, c, color, vr, dims, isoBufferGrid, vertices);
+				contouring::StageTimer timer(profile.pyramid);
+				if (smoothed)
+				{
+					pyramid.update(smoothedField, cells.x0, cells.y0, cells.x1, cells.y1);
+				}
+				else
+				{
+					pyramid.update(field, cells.x0, cells.y0, cells.x1, cells.y1);
+				}
 			}
+			contouring::markContourPieces(extraction, cells, dirty);
 		}
+
+		// Every cached level is brought up to date
+		std::vector<double> isoValues;
+		for (const auto& level : slice.levels)
+		{
+			isoValues.push_back(level.first);
+		}
+		const double* begin = isoValues.data();
+		const double* end = isoValues.data() + isoValues.size();
+		if (smoothed)
+		{
+			this->extractPieces(smoothedField, slice, begin, end, dirty, state, sliceThreads, profile);
+		}
+		else
+		{
+			this->extractPieces(field, slice, begin, end, dirty, state, sliceThreads, profile);
+		}
+	});
+
+	// The number of changed blocks is shown with the statistics
+	for (const auto& profile : profiles)
+	{
+		profile_ += profile;
 	}
+	return std::find(rebuild.begin(), rebuild.end(), 1) == rebuild.end();
 }
 
-void MarchingSquares::drawSingleIsoline(float ix, float iy, const double c, const vec4& color, const VolumeRAM* vr, const size3_t dims, IndexBufferRAM* isoBufferGrid,
-	std::vector<BasicMesh::Vertex>& vertices)
+template <typename T>
+void MarchingSquares::extractPieces(const contouring::FieldView<T>& field, SliceCache& slice,
+	const double* begin, const double* end, const std::vector<std::uint8_t>& dirty, const ExtractionState& state,
+	size_t numThreads, Profile& profile, const std::atomic<bool>* cancel)
 {
-	float f00 = getInputValue(vr, dims, ix, iy);
-	float f01 = getInputValue(vr, dims, ix, iy + 1);
-	float f11 = getInputValue(vr, dims, ix + 1, iy + 1);
-	float f10 = getInputValue(vr, dims, ix + 1, iy);
+	const auto decider = state.decider;
+	const bool segments = state.extraction == contouring::Extraction::Segments;
+	const size_t numLevels = end - begin;
 
-	vec2 coord[] = { vec2(ix,iy),vec2(ix,iy+1),vec2(ix+1,iy+1),vec2(ix+1,iy) };
-	vec2 dir[] = { vec2(0,1), vec2(1,0), vec2(0,-1), vec2(-1,0) }; // This is a bit messy but basically it shows in which direction we have 
-																	// to add the 'x' for each of the cases
-	float f[] = { f00,f01,f11,f10 };
+	std::vector<LevelGeometry*> geometries(numLevels);
+	std::vector<contouring::ContourPieces*> pieces(numLevels);
+	for (size_t level = 0; level < numLevels; level++)
+	{
+		geometries[level] = &slice.levels.at(begin[level]);
+		pieces[level] = &geometries[level]->pieces;
+	}
 
-	std::vector<vec2> p;
-	float f1, f2;
+	contouring::StageTimer timer(profile.extraction);
+	const auto& pyramid = slice.acceleration.pyramid;
+	if (segments)
+	{
+		contouring::extractSegmentPieces(field, begin, end, decider, pyramid, dirty, pieces.data(),
+			numThreads, &profile.counters, cancel);
+	}
+	else
+	{
+		contouring::extractPolylinePieces(field, begin, end, decider, pyramid, dirty, pieces.data(),
+			numThreads, &profile.counters, cancel);
+	}
+	// Cancelled pieces are incomplete, the job drops their levels (see pollBackgroundJob)
+	if (contouring::isCancelled(cancel)) return;
 
-	for (size_t it = 0; it < 4; it++)
+	// Joining is linear in the size of the contours
+	contouring::parallelForEach(numLevels, contouring::resolveThreadCount(numThreads, numLevels),
+		[&](size_t level, size_t)
 	{
-		if (it < 3)
+		LevelGeometry& geometry = *geometries[level];
+		if (segments)
 		{
-			f1 = f[it];
-			f2 = f[it + 1];
+			contouring::joinSegmentPieces(geometry.pieces, geometry.segments);
 		}
 		else
 		{
-			f1 = f[it];
-			f2 = f[0];
+			contouring::joinPolylinePieces(geometry.pieces, field.nx - 1, geometry.contour);
 		}
-		if ((f1 < c && f2 >= c) || (f2 < c && f1 >= c))
+	});
+}
+
+bool MarchingSquares::updateGrid(const size3_t& dims)
+{
+	if (!propShowGrid.get()) return false;
+
+	// Without level of detail every line is drawn
+	size_t strideX = 1;
+	size_t strideY = 1;
+	if (propGridLod.get())
+	{
+		strideX = gridLineStride(dims.x, propGridSpacing.get());
+		strideY = gridLineStride(dims.y, propGridSpacing.get());
+	}
+
+	// The end points only depend on the grid dimensions and the strides
+	if (gridDims_ == dims && gridStride_ == size2_t(strideX, strideY)) return false;
+	gridDims_ = dims;
+	gridStride_ = size2_t(strideX, strideY);
+	gridPoints_.clear();
+
+	auto addVertical = [&](size_t i)
+	{
+		float ix = 1.0 / (dims.x - 1) * i;
+		gridPoints_.push_back(vec2(ix, 0));
+		gridPoints_.push_back(vec2(ix, 1));
+	};
+	auto addHorizontal = [&](size_t j)
+	{
+		float iy = 1.0 / (dims.y - 1) * j;
+		gridPoints_.push_back(vec2(0, iy));
+		gridPoints_.push_back(vec2(1, iy));
+	};
+
+	// Every stride-th line, the last one is always kept to close the border
+	for (size_t i = 0; i < dims.x; i += strideX)
+	{
+		addVertical(i);
+	}
+	if ((dims.x - 1) % strideX != 0) addVertical(dims.x - 1);
+
+	for (size_t j = 0; j < dims.y; j += strideY)
+	{
+		addHorizontal(j);
+	}
+	if ((dims.y - 1) % strideY != 0) addHorizontal(dims.y - 1);
+
+	return true;
+}
+
+void MarchingSquares::assembleMesh(const size3_t& dims, const std::vector<double>& isoValues,
+	const std::vector<vec4>& isoColors, const std::vector<vec4>& bandColors,
+	const std::vector<SliceCache>& slices)
+{
+	meshPositions_.clear();
+	meshColors_.clear();
+	meshIndices_.clear();
+	meshLines_.clear();
+	meshBuffersValid_ = false;
+
+	// Without simplification the sizes are known up front, the buffers rarely grow
+	// once they have the size of the first run
+	size_t numPositions = propShowGrid.get() ? gridPoints_.size() : 0;
+	size_t numIndices = numPositions;
+	for (const auto& slice : slices)
+	{
+		for (const auto& level : slice.levels)
 		{
-			float x = (c - f1) / (f2 - f1); //Compute interpolation
-			vec2 pIso = vec2((coord[it].x + x*dir[it].x) / (dims.x - 1), (coord[it].y + x*dir[it].y) / (dims.y - 1));
-			p.push_back(pIso);
+			numPositions += level.second.segments.size() + level.second.contour.vertices.size();
+			// A restart index after every isoline and the first index again at the end of a loop
+			numIndices += level.second.segments.size() + level.second.contour.indices.size() +
+				2 * level.second.contour.polylines.size();
+		}
+		for (const auto& band : slice.bands)
+		{
+			numPositions += band.vertices.size();
+			numIndices += band.triangles.size();
 		}
 	}
+	meshPositions_.reserve(numPositions);
+	meshIndices_.reserve(numIndices);
+
+	// Bands
 
-	// Draw line
-	int count = p.size();
-	if (count == 2)
+	// The bands are drawn first so that the grid and the contours are drawn over them
+	const bool bands = showBands();
+	if (bands)
 	{
-		drawLineSegment(p[0], p[1], color, isoBufferGrid, vertices);
+		for (size_t s = 0; s < slices.size(); s++)
+		{
+			const float z = sliceHeight(dims, sliceBegin_ + s);
+			for (size_t k = 0; k < bandColors.size(); k++)
+			{
+				const size_t first = meshPositions_.size();
+				drawBand(slices[s].bands[k], z);
+				meshColors_.push_back({ first, meshPositions_.size(), bandColors[k] });
+			}
+		}
 	}
-	else if (count == 4) //Ambiguity!
-	{
-		if (propDeciderType.get() == 0) // Midpoint decider:
+
+    // Grid
+
+    // Properties are accessed with propertyName.get() 
+    if (propShowGrid.get())
+    {
+        // TODO: Add grid lines of the given color 
+
+        // The function drawLineSegments creates two vertices at the specified positions, 
+        // that are placed into the Vertex vector defining our mesh. 
+        // An index buffer specifies which of those vertices should be grouped into to make up lines/trianges/quads.
+        // Here two vertices make up a line segment.
+		// The grid is drawn once, at the height of the first slice
+		const size_t first = meshPositions_.size();
+		const size_t firstIndex = meshIndices_.size();
+		for (size_t i = 0; i + 1 < gridPoints_.size(); i += 2)
 		{
-			float fc = 0.25*(f00 + f01 + f10 + f11);
+			drawLineSegment(gridPoints_[i], gridPoints_[i + 1], meshIndices_, meshPositions_,
+				sliceHeight(dims, sliceBegin_));
+		}
+		addLines(ConnectivityType::None, firstIndex);
+		meshColors_.push_back({ first, meshPositions_.size(), propGridColor.get() });
+    }
 
-			if ((fc < c) && (f00 < c) || ((fc >= c) && (f00 >= c)))
+    // Iso contours
+
+	// All levels of one slice before the next slice
+	for (size_t s = 0; s < slices.size(); s++)
+	{
+		const float z = sliceHeight(dims, sliceBegin_ + s);
+		for (size_t level = 0; level < isoValues.size(); level++)
+		{
+			const size_t first = meshPositions_.size();
+			const LevelGeometry& geometry = slices[s].levels.at(isoValues[level]);
+			if (extractionMode() == 0)
 			{
-				drawLineSegment(p[0], p[1], color, isoBufferGrid, vertices);
-				drawLineSegment(p[2], p[3], color, isoBufferGrid, vertices);
+				const size_t firstIndex = meshIndices_.size();
+				const auto& points = geometry.segments;
+				for (size_t i = 0; i + 1 < points.size(); i += 2)
+				{
+					drawLineSegment(points[i], points[i + 1], meshIndices_, meshPositions_, z);
+				}
+				addLines(ConnectivityType::None, firstIndex);
 			}
 			else
 			{
-				drawLineSegment(p[0], p[3], color, isoBufferGrid, vertices);
-				drawLineSegment(p[1], p[2], color, isoBufferGrid, vertices);
+				drawPolylines(geometry.contour, z);
 			}
+			meshColors_.push_back({ first, meshPositions_.size(), isoColors[level] });
+		}
+	}
+
+	meshGrid_ = propShowGrid.get();
+	meshBands_ = bands;
+	meshSlices_ = slices.size();
+	meshIsoValues_ = isoValues;
+	meshSimplification_ = propSimplification.get();
+	meshTolerance_ = propSimplifyTolerance.get();
+	meshValid_ = true;
+}
+
+void MarchingSquares::recolorMesh(const std::vector<vec4>& isoColors, const std::vector<vec4>& bandColors)
+{
+	const size_t numBandRanges = meshBands_ ? meshSlices_ * bandColors.size() : 0;
+	const size_t firstLevel = numBandRanges + (meshGrid_ ? 1 : 0);
+	for (size_t i = 0; i < meshColors_.size(); i++)
+	{
+		// The bands and the levels repeat for every slice
+		if (i < numBandRanges)
+		{
+			meshColors_[i].color = bandColors[i % bandColors.size()];
+		}
+		else
+		{
+			meshColors_[i].color = i < firstLevel ? propGridColor.get() : isoColors[(i - firstLevel) % isoColors.size()];
+		}
+	}
+	// Only the color buffer of the full format is filled again
+	meshBuffers_[meshBufferSet_].colorsValid = false;
+}
+
+std::shared_ptr<Mesh> MarchingSquares::buildMesh()
+{
+	auto& counters = profile_.counters;
+	// The full format needs vec3 positions, the compact one leaves z out for flat lines
+	const bool full = propMeshFormat.get() == 0;
+	if (!meshBuffersValid_ || (full && !meshBuffers_[meshBufferSet_].positions)) updateMeshBuffers();
+	MeshBuffers& buffers = meshBuffers_[meshBufferSet_];
+
+	if (full)
+	{
+		// The buffers of a BasicMesh, kept like the positions. Normal and texture
+		// coordinate are not used, but every vertex still has them.
+		const size_t numVertices = meshPositions_.size();
+		if (!buffers.attributesValid)
+		{
+			auto& normals = *unsharedBuffer(buffers.normals).getEditableRAMRepresentation()->getDataContainer();
+			normals.assign(numVertices, vec3(0, 0, 1));
+			auto& texcoords = *unsharedBuffer(buffers.texcoords).getEditableRAMRepresentation()->getDataContainer();
+			texcoords.assign(meshPositions_.begin(), meshPositions_.end());
+			counters.countBytes(contouring::vectorBytes(normals) + contouring::vectorBytes(texcoords));
+			buffers.attributesValid = true;
 		}
-		else // Asymptotic decider:
+		if (!buffers.colorsValid)
 		{
-			float fab = (f00 * f11 - f10 * f01) / (f11 + f00 - f01 - f10); // There was a faster solution by sorting the values...
-			if (((c >= fab) && (f00 >= c)) || ((c < fab) && (f00 < c)))
+			auto& colors = *unsharedBuffer(buffers.colors).getEditableRAMRepresentation()->getDataContainer();
+			colors.resize(numVertices);
+			for (const auto& range : meshColors_)
 			{
-				drawLineSegment(p[0], p[3], color, isoBufferGrid, vertices);
-				drawLineSegment(p[1], p[2], color, isoBufferGrid, vertices);
+				std::fill(colors.begin() + range.begin, colors.begin() + range.end, range.color);
 			}
-			else
+			counters.countBytes(contouring::vectorBytes(colors));
+			buffers.colorsValid = true;
+		}
+
+		auto mesh = std::make_shared<Mesh>(DrawType::Lines, ConnectivityType::None);
+		mesh->addBuffer(BufferType::PositionAttrib, buffers.positions);
+		mesh->addBuffer(BufferType::NormalAttrib, buffers.normals);
+		mesh->addBuffer(BufferType::TexcoordAttrib, buffers.texcoords);
+		mesh->addBuffer(BufferType::ColorAttrib, buffers.colors);
+		for (size_t i = 0; i < meshLines_.size(); i++)
+		{
+			mesh->addIndicies(Mesh::MeshInfo(meshLines_[i].drawType, meshLines_[i].connectivity),
+				buffers.indices[i]);
+		}
+		return mesh;
+	}
+
+	auto mesh = std::make_shared<Mesh>(DrawType::Lines, ConnectivityType::None);
+	if (buffers.flatPositions)
+	{
+		mesh->addBuffer(BufferType::PositionAttrib, buffers.flatPositions);
+	}
+	else
+	{
+		mesh->addBuffer(BufferType::PositionAttrib, buffers.positions);
+	}
+
+	// Isovalues normalized like the transfer function samples them, the bands and the
+	// levels repeat for every slice. A band has the value in its middle and the grid
+	// the low end of the range. They only have to be filled again if the geometry or
+	// the range of the isovalue changed.
+	const float minValue = propIsoValue.getMinValue();
+	const float maxValue = propIsoValue.getMaxValue();
+	if (!buffers.scalarsValid || buffers.scalarRange != vec2(minValue, maxValue))
+	{
+		const double range = static_cast<double>(maxValue) - minValue;
+		const size_t numBands = meshIsoValues_.size() + 1;
+		const size_t numBandRanges = meshBands_ ? meshSlices_ * numBands : 0;
+		const size_t firstLevel = numBandRanges + (meshGrid_ ? 1 : 0);
+		auto& scalars = *unsharedBuffer(buffers.scalars).getEditableRAMRepresentation()->getDataContainer();
+		scalars.resize(meshPositions_.size());
+		for (size_t i = 0; i < meshColors_.size(); i++)
+		{
+			float scalar = 0.0f;
+			if (i < numBandRanges || i >= firstLevel)
 			{
-				drawLineSegment(p[0], p[1], color, isoBufferGrid, vertices);
-				drawLineSegment(p[2], p[3], color, isoBufferGrid, vertices);
+				const double value = i < numBandRanges ?
+					bandMidValue(meshIsoValues_, i % numBands, minValue, maxValue) :
+					meshIsoValues_[(i - firstLevel) % meshIsoValues_.size()];
+				scalar = range > 0.0 ? static_cast<float>((value - minValue) / range) : 0.0f;
 			}
+			std::fill(scalars.begin() + meshColors_[i].begin, scalars.begin() + meshColors_[i].end, scalar);
 		}
+		counters.countBytes(contouring::vectorBytes(scalars));
+		buffers.scalarRange = vec2(minValue, maxValue);
+		buffers.scalarsValid = true;
+	}
+	mesh->addBuffer(BufferType::TexcoordAttrib, buffers.scalars);
+
+	for (size_t i = 0; i < meshLines_.size(); i++)
+	{
+		mesh->addIndicies(Mesh::MeshInfo(meshLines_[i].drawType, meshLines_[i].connectivity), buffers.indices[i]);
 	}
+	return mesh;
 }
 
-double MarchingSquares::getInputValue(const VolumeRAM* data, const size3_t dims, 
-    const size_t i, const size_t j) {
-    // Check if the indices are withing the dimensions of the volume
-    if (i < dims.x && j < dims.y) {
-        return data->getAsDouble(size3_t(i, j, 0));
-    } else {
-        LogProcessorError(
-            "Attempting to access data outside the boundaries of the volume, value is set to 0");
-        return 0;
-    }
+void MarchingSquares::updateMeshBuffers()
+{
+	// The set filled last is held by the mesh handed out last. Its buffers must not change,
+	// so the other set is filled, reusing only the buffers no mesh holds anymore.
+	auto& counters = profile_.counters;
+	meshBufferSet_ = 1 - meshBufferSet_;
+	MeshBuffers& buffers = meshBuffers_[meshBufferSet_];
+
+	// The compact format leaves the z coordinate out if every line lies in the xy-plane
+	const bool flat = propMeshFormat.get() != 0 && std::all_of(meshPositions_.begin(),
+		meshPositions_.end(), [](const vec3& p) { return p.z == 0.0f; });
+	if (flat)
+	{
+		auto& positions = *unsharedBuffer(buffers.flatPositions).getEditableRAMRepresentation()->getDataContainer();
+		positions.clear();
+		positions.reserve(meshPositions_.size());
+		for (const auto& p : meshPositions_)
+		{
+			positions.emplace_back(p.x, p.y);
+		}
+		counters.countBytes(contouring::vectorBytes(positions));
+		buffers.positions.reset();
+	}
+	else
+	{
+		auto& positions = *unsharedBuffer(buffers.positions).getEditableRAMRepresentation()->getDataContainer();
+		positions.assign(meshPositions_.begin(), meshPositions_.end());
+		counters.countBytes(contouring::vectorBytes(positions));
+		buffers.flatPositions.reset();
+	}
+	buffers.scalarsValid = false;
+	buffers.attributesValid = false;
+	buffers.colorsValid = false;
+
+	// One buffer of triangles for the bands, one of lines for the grid and the segments
+	// of the levels, and one strip or loop per polyline
+	buffers.indices.resize(meshLines_.size());
+	for (size_t i = 0; i < meshLines_.size(); i++)
+	{
+		auto& indices = *unsharedBuffer(buffers.indices[i]).getEditableRAMRepresentation()->getDataContainer();
+		indices.assign(meshIndices_.begin() + meshLines_[i].begin, meshIndices_.begin() + meshLines_[i].end);
+		counters.countBytes(contouring::vectorBytes(indices));
+	}
+	meshBuffersValid_ = true;
 }
 
-void MarchingSquares::drawLineSegment(const vec2& v1, const vec2& v2, const vec4& color,
-                                      IndexBufferRAM* indexBuffer,
-                                      std::vector<BasicMesh::Vertex>& vertices) {
-    // Add first vertex
-    indexBuffer->add(static_cast<std::uint32_t>(vertices.size()));
-    // A vertex has a position, a normal, a texture coordinate and a color
-    // we do not use normal or texture coordinate, but still have to specify them
-    vertices.push_back({vec3(v1[0], v1[1], 0), vec3(0, 0, 1), vec3(v1[0], v1[1], 0), color});
-    // Add second vertex
-    indexBuffer->add(static_cast<std::uint32_t>(vertices.size()));
-    vertices.push_back({vec3(v2[0], v2[1], 0), vec3(0, 0, 1), vec3(v2[0], v2[1], 0), color});
+template <typename T>
+contouring::FieldView<float> MarchingSquares::gaussianSmoothing(const contouring::FieldView<T>& field,
+	SliceCache& slice, size_t numThreads, contouring::GaussianFilterStats& stats,
+	const std::atomic<bool>* cancel) const
+{
+	// The result stays valid until the input or the filter settings change. The
+	// samples kept for temporal coherence do not have to be gathered again.
+	if (slice.smoothed.empty() && !slice.previous.empty())
+	{
+		slice.smoothed.resize(field.nx * field.ny);
+		stats = filter_.apply(slice.previous.data(), slice.smoothed.data(), field.nx, field.ny, numThreads,
+			cancel, &slice.filterScratch.rowPass);
+	}
+	else if (slice.smoothed.empty())
+	{
+		stats = contouring::smoothField(field, filter_, slice.smoothed, numThreads, cancel,
+			&slice.filterScratch);
+	}
+	// A cancelled filter leaves an incomplete result, the next run filters again
+	if (stats.cancelled)
+	{
+		slice.smoothed.clear();
+	}
+
+	return contouring::FieldView<float>(slice.smoothed.data(), field.nx, field.ny);
+}
+
+MarchingSquares::Profile& MarchingSquares::Profile::operator+=(const Profile& other)
+{
+	filter += other.filter;
+	pyramid += other.pyramid;
+	extraction += other.extraction;
+	grid += other.grid;
+	mesh += other.mesh;
+	upload += other.upload;
+	total += other.total;
+	simplification += other.simplification;
+	counters += other.counters;
+	verticesBeforeSimplification += other.verticesBeforeSimplification;
+	verticesAfterSimplification += other.verticesAfterSimplification;
+	changedBlocks += other.changedBlocks;
+	return *this;
+}
+
+void MarchingSquares::publishProfile()
+{
+#if LABMARCHINGSQUARES_PROFILING
+	const auto& counters = profile_.counters;
+	propTimeFilter.set(profile_.filter);
+	propTimePyramid.set(profile_.pyramid);
+	propTimeExtraction.set(profile_.extraction);
+	propTimeGrid.set(profile_.grid);
+	propTimeMesh.set(profile_.mesh);
+	propTimeUpload.set(profile_.upload);
+	propTimeTotal.set(profile_.total);
+	propCellsScanned.set(counters.cellsScanned);
+	propActiveCells.set(counters.activeCells);
+	propAmbiguousAbove.set(counters.ambiguousJoinedAbove);
+	propAmbiguousBelow.set(counters.ambiguousJoinedBelow);
+	propSegments.set(counters.segments);
+	propVertices.set(counters.vertices);
+	propBytesAllocated.set(counters.bytesAllocated);
+	propTimeSimplification.set(profile_.simplification);
+	propVerticesBeforeSimplification.set(profile_.verticesBeforeSimplification);
+	propVerticesAfterSimplification.set(profile_.verticesAfterSimplification);
+	propChangedBlocks.set(profile_.changedBlocks);
+
+	if (propStatisticsLog.get())
+	{
+		LogProcessorInfo("profile filter_ms=" << profile_.filter << " pyramid_ms=" << profile_.pyramid
+			<< " extraction_ms=" << profile_.extraction << " grid_ms=" << profile_.grid
+			<< " mesh_ms=" << profile_.mesh << " upload_ms=" << profile_.upload
+			<< " total_ms=" << profile_.total << " cells_scanned=" << counters.cellsScanned
+			<< " active_cells=" << counters.activeCells
+			<< " ambiguous_joined_above=" << counters.ambiguousJoinedAbove
+			<< " ambiguous_joined_below=" << counters.ambiguousJoinedBelow
+			<< " segments=" << counters.segments << " vertices=" << counters.vertices
+			<< " bytes_allocated=" << counters.bytesAllocated
+			<< " simplification_ms=" << profile_.simplification
+			<< " vertices_before_simplification=" << profile_.verticesBeforeSimplification
+			<< " vertices_after_simplification=" << profile_.verticesAfterSimplification
+			<< " changed_blocks=" << profile_.changedBlocks);
+	}
+#endif
 }
 
-const double MarchingSquares::gaussian(int x, int y, float sigma) {
-	return (1.0 / (2.0*sigma*M_PI) * exp(-(pow(x, 2) + pow(y, 2)) / (2 * pow(sigma, 2))));
+void MarchingSquares::drawPolylines(const contouring::ContourGeometry& contour, float z)
+{
+	// Without simplification every vertex is kept
+	auto& keep = keepScratch_;
+	keep.clear();
+	const auto method = static_cast<contouring::Simplification>(propSimplification.get());
+	if (method != contouring::Simplification::None)
+	{
+		size_t numKept = 0;
+		{
+			contouring::StageTimer timer(profile_.simplification);
+			numKept = contouring::simplifyPolylines(contour, method, propSimplifyTolerance.get(), keep,
+				propThreads.get());
+		}
+		profile_.verticesBeforeSimplification += contour.vertices.size();
+		profile_.verticesAfterSimplification += numKept;
+	}
+	auto kept = [&](std::uint32_t v) { return keep.empty() || keep[v]; };
+
+	// Index of every kept vertex in the mesh
+	auto& meshIndex = meshIndexScratch_;
+	meshIndex.resize(contour.vertices.size());
+	for (std::uint32_t v = 0; v < contour.vertices.size(); v++)
+	{
+		if (!kept(v)) continue;
+		meshIndex[v] = static_cast<std::uint32_t>(meshPositions_.size());
+		meshPositions_.emplace_back(contour.vertices[v].x, contour.vertices[v].y, z);
+	}
+
+	// All isolines of the level share one strip, separated by restartIndex. A loop
+	// repeats its first vertex at the end.
+	const size_t firstIndex = meshIndices_.size();
+	for (const auto& line : contour.polylines)
+	{
+		const size_t lineBegin = meshIndices_.size();
+		for (size_t i = line.begin; i < line.end; i++)
+		{
+			const std::uint32_t index = contour.indices[i];
+			if (kept(index)) meshIndices_.push_back(meshIndex[index]);
+		}
+		if (meshIndices_.size() == lineBegin) continue;
+		if (line.closed) meshIndices_.push_back(meshIndices_[lineBegin]);
+		meshIndices_.push_back(restartIndex);
+	}
+	if (meshIndices_.size() == firstIndex) return;
+	// The strip does not end with a restart
+	meshIndices_.pop_back();
+	addLines(ConnectivityType::Strip, firstIndex);
+}
+
+void MarchingSquares::addLines(ConnectivityType connectivity, size_t begin)
+{
+	if (connectivity == ConnectivityType::None && !meshLines_.empty() &&
+		meshLines_.back().drawType == DrawType::Lines &&
+		meshLines_.back().connectivity == ConnectivityType::None && meshLines_.back().end == begin)
+	{
+		meshLines_.back().end = meshIndices_.size();
+		return;
+	}
+	meshLines_.push_back({ DrawType::Lines, connectivity, begin, meshIndices_.size() });
+}
+
+void MarchingSquares::drawBand(const contouring::BandGeometry& band, float z)
+{
+	const auto offset = static_cast<std::uint32_t>(meshPositions_.size());
+	for (const auto& p : band.vertices)
+	{
+		meshPositions_.emplace_back(p.x, p.y, z);
+	}
+
+	// The bands only differ in their vertex colors, so all of them share one index buffer
+	const size_t firstIndex = meshIndices_.size();
+	for (const auto index : band.triangles)
+	{
+		meshIndices_.push_back(offset + index);
+	}
+	if (!meshLines_.empty() && meshLines_.back().drawType == DrawType::Triangles &&
+		meshLines_.back().end == firstIndex)
+	{
+		meshLines_.back().end = meshIndices_.size();
+		return;
+	}
+	meshLines_.push_back({ DrawType::Triangles, ConnectivityType::None, firstIndex, meshIndices_.size() });
+}
+
+void MarchingSquares::drawLineSegment(const vec2& v1, const vec2& v2,
+                                      std::vector<std::uint32_t>& indices,
+                                      std::vector<vec3>& positions, float z) {
+    // Add first vertex
+    indices.push_back(static_cast<std::uint32_t>(positions.size()));
+    // Only the position is kept, normal, texture coordinate and color are added by buildMesh
+    positions.push_back(vec3(v1[0], v1[1], z));
+    // Add second vertex
+    indices.push_back(static_cast<std::uint32_t>(positions.size()));
+    positions.push_back(vec3(v2[0], v2[1], z));
 }
 
 } // namespace
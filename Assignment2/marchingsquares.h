@@ -16,11 +16,33 @@
 #include <inviwo/core/ports/volumeport.h>
 #include <inviwo/core/ports/meshport.h>
 #include <inviwo/core/properties/boolproperty.h>
+#include <inviwo/core/properties/compositeproperty.h>
+#include <inviwo/core/properties/fileproperty.h>
+#include <inviwo/core/properties/minmaxproperty.h>
 #include <inviwo/core/properties/optionproperty.h>
 #include <inviwo/core/properties/ordinalproperty.h>
 #include <inviwo/core/properties/transferfunctionproperty.h>
 #include <inviwo/core/datastructures/volume/volumeram.h>
 #include <inviwo/core/datastructures/geometry/basicmesh.h>
+#include <inviwo/core/datastructures/buffer/buffer.h>
+#include <labmarchingsquares/coherentextraction.h>
+#include <labmarchingsquares/gaussianfilter.h>
+#include <labmarchingsquares/isobandextraction.h>
+#include <labmarchingsquares/scalarfield.h>
+#include <labmarchingsquares/contourgeometry.h>
+#include <labmarchingsquares/contouringpipeline.h>
+#include <labmarchingsquares/polylinesimplification.h>
+#include <labmarchingsquares/profiling.h>
+#include <labmarchingsquares/rawfield.h>
+#include <labmarchingsquares/workingfield.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
 
 namespace inviwo
 {
@@ -35,37 +57,206 @@ namespace inviwo
       value within each voxel) but it is represented by a 3-dimensional volume. 
       This processor deals with 2-dimensional data only, therefore it is assumed 
       the z-dimension will have size 1 otherwise the 0th slice of the volume 
-      will be processed
+      will be processed, or every slice of a chosen range (see propSlices)
     
     ### Outports
       * __mesh__ The output mesh contains (possibly multiple) iso contours as well as gridlines
     
     ### Properties
       * __propShowGrid__ Display grid lines if true, do not display grid lines if false.
-      * __propGridColor__ Color of the grid lines
+      * __propGridColor__ Color of the grid lines, in the full mesh format only
+      * __propGridLod__ Draw only every k-th grid line so that lines are not closer than propGridSpacing,
+        the border lines are always drawn
+      * __propGridSpacing__ Minimum distance between drawn grid lines in normalized [0,1] units
       * __propDeciderType__ Type of decider for ambiguities in marching squares
+      * __propExtraction__ Emit independent line segments per cell (one index buffer for the grid
+        and all levels), or shared vertices joined into polylines (one line strip index buffer
+        per level and slice, the isolines are separated by the restart index 0xFFFFFFFF and a
+        loop repeats its first vertex, so the renderer has to enable primitive restart with that
+        index, e.g. GL_PRIMITIVE_RESTART_FIXED_INDEX). Contour following gives the same polylines
+        as the shared vertex mode, and the same segments as the segment mode (the original
+        drawIsolineSingleValue) up to rounding of the last bits, but traces them cell to cell from
+        seed cells found once per slice (border cells and cells next to local extrema). On smooth
+        fields its cost depends on the length of the isolines rather than on the number of cells.
+        On noise and on quantized data with plateaus almost every cell is a seed, the seeds cost
+        25-40 ns per cell and following is 2-4 times slower than the shared vertex mode. While
+        streaming it falls back to the shared vertex mode
+      * __propSimplification__ Reduce the polylines with Douglas-Peucker (no vertex further than
+        propSimplifyTolerance from the simplified line) or Visvalingam-Whyatt (drop vertices whose
+        triangle with their neighbors is smaller than the tolerance squared). The polylines are
+        simplified in parallel while the mesh is assembled. Line segments are extracted as shared
+        vertex polylines while simplification is on
+      * __propSimplifyTolerance__ Tolerance of the simplification in normalized [0,1] units
       * __propMultiple__ Display of one iso contour or multiple
       * __propIsoValue__ Iso value for one iso contour
-      * __propIsoColor__ Color for iso contour(s)
+      * __propIsoColor__ Color for iso contour(s), in the full mesh format only
       * __propNumContours__ Number of isocontours to be displayed between minimum and maximum data value
       * __propIsoTransferFunc__ Transfer function to be used to color those multiple contours
+      * __propBands__ Also fill the bands between the multiple contours with triangles, colored
+        by the transfer function at the middle of each band. The outer bands reach down to the
+        minimum and up to the maximum value. All bands are extracted in one sweep over the cells,
+        with the ambiguities resolved by propDeciderType like for the contours, so the band edges
+        match them. The bands are drawn before the grid and the contours. Not available while
+        streaming, with temporal coherence they are extracted in full for every changed frame
+      * __propMeshFormat__ Vertex layout of the output mesh. Full vertices have the buffers of a
+        BasicMesh, position, normal, texture coordinate and color (52 bytes per vertex). The compact
+        format only holds positions, as vec2 if all lines lie in z = 0 and as vec3 otherwise, plus
+        a float in the texture coordinate slot (12 or 16 bytes per vertex): the isovalue normalized
+        like for the transfer function, the middle value for a band and 0 for the grid lines. It
+        has no colors, so propIsoColor and propGridColor do not apply to it. It is colored by
+        mapping the texture coordinate through a transfer function before rendering, e.g. with a
+        mesh mapping processor in front of the mesh renderer
+      * __propApplyGaussian__ Smooth the data with a Gaussian filter before extracting contours
+      * __propSigma__ Standard deviation of the Gaussian filter, the kernel radius is ceil(3 sigma)
+      * __propSlices__ Extract contours from the 0th slice only, or from every slice in propSliceRange.
+        The slices are processed in parallel and placed at z = slice / (dims.z - 1) in one mesh
+      * __propSliceRange__ First and last slice extracted in slice range mode
+      * __propThreads__ Number of threads for filtering and extraction, 0 uses one thread per core
+      * __propBackground__ Filter and extract on a background thread, so that the network stays
+        responsive while isovalue or sigma sliders are dragged on large fields. A run started while
+        the extraction is busy with an older state cancels it. The filter stops within a block
+        of rows and the kernels within a block row or column, their incomplete results are
+        dropped, and the newest state is extracted once the job has stopped. The final mesh is
+        the same as without it. Not used while streaming
+      * __propPreviewStride__ With background extraction, first show the contours of the field
+        subsampled to every k-th sample along x and y, then replace them with those of the full
+        field. The preview uses the smoothed field if it is there already and the unsmoothed one
+        otherwise. 1 shows no preview
+      * __propTemporalCoherence__ For time series that change only in places from frame to frame.
+        A new volume of the same size is compared with the last one in blocks of 16 x 16 samples,
+        only the changed blocks plus the halo of the Gaussian filter are smoothed again and only
+        the block columns (line segments) or block rows (polylines) holding changed cells are
+        extracted again. The result is the same as without it. Frames where more than half of the
+        blocks changed, and contour following, are processed in full. Keeps a float copy of the
+        processed slices
+      * __propWorkingCopy__ Extract the unsmoothed slices from a narrower copy made once per input.
+        Slices whose samples are all integers in the range of 16 bit integers are kept in 16 bits,
+        other double and 32 bit integer slices as float, and the rest is read in place. The copy
+        holds exactly the values the extraction sees, so the contours are the same. It is kept in
+        addition to the input volume, so it costs memory and only saves memory bandwidth in the
+        cell loops of repeated runs. Off by default, not used in temporal coherence mode
+      * __propStreaming__ Extract contours from a raw file on disk instead of the inport. The file
+        is memory-mapped and read in tiles of propStreamTileSize cells (plus the halo of the
+        Gaussian filter), so memory use depends on the tile size rather than on the field size.
+        propStreamDims, propStreamType and propStreamOffset describe the layout of the file, the
+        header may be larger than 2 GiB.
+      * __propStatistics__ Read-only wall time of every stage of the last run and counters of the
+        extraction. Times of filtering, pyramid and extraction are summed over slices processed
+        in parallel, while streaming the filter runs per tile and is part of the extraction time.
+        The pyramid time includes making the compact working copy, in contour following mode it is
+        that of building the seeds. Simplification is part of mesh assembly, its time and the
+        vertex counts before and after are also shown. propStatisticsLog also prints them as one
+        line of key=value pairs. With temporal coherence the comparison with the last frame is part
+        of the filter time and the number of changed blocks is shown. Not available when the module
+        is built with LABMARCHINGSQUARES_PROFILING=0.
 */
 class IVW_MODULE_LABMARCHINGSQUARES_API MarchingSquares : public Processor
 { 
 //Friends
 //Types
-public:
+private:
+	// Contours of one isovalue, in the form of the extraction mode they were made with
+	struct LevelGeometry
+	{
+		std::vector<vec2> segments;
+		contouring::ContourGeometry contour;
+		// Block columns or rows the contours are joined from in temporal coherence mode
+		contouring::ContourPieces pieces;
+	};
+	// Everything computed for one slice of the input
+	struct SliceCache
+	{
+		// Smoothed slice, empty until it is needed
+		std::vector<float> smoothed;
+		// Buffers of the Gaussian filter, kept so that filtering again allocates nothing
+		contouring::SmoothingScratch filterScratch;
+		// Float samples of the slice the caches belong to, kept in temporal coherence mode
+		std::vector<float> previous;
+		// Compact copy of the unsmoothed slice, made the first time it is extracted from
+		contouring::WorkingField working;
+		bool workingBuilt = false;
+		// Min/max pyramid and seed cells of the field contours are extracted from
+		contouring::FieldAcceleration acceleration;
+		// Contours per isovalue, valid for the current decider and extraction mode
+		std::map<double, LevelGeometry> levels;
+		// Geometry of dropped levels, its memory is handed to the next extraction
+		std::vector<LevelGeometry> spareLevels;
+		// Output and scratch buffers of the extraction, kept for the next one
+		contouring::ContourLevels extracted;
+		contouring::ExtractionWorkspace workspace;
+		// Filled bands between the isovalues bandIsoValues, empty if there are none
+		std::vector<contouring::BandGeometry> bands;
+		std::vector<double> bandIsoValues;
+	};
+	// Property state the contours are extracted with, read once so that the
+	// extraction can run on another thread
+	struct ExtractionState
+	{
+		bool smoothed;
+		float sigma;
+		bool temporal;
+		bool workingCopy;
+		contouring::Decider decider;
+		contouring::Extraction extraction;
+		size_t numThreads;
+
+		bool operator==(const ExtractionState& other) const;
+	};
+	// Wall time in ms of the stages of one run, and what the extraction did
+	struct Profile
+	{
+		double filter = 0.0;
+		double pyramid = 0.0;
+		double extraction = 0.0;
+		double grid = 0.0;
+		double mesh = 0.0;
+		double upload = 0.0;
+		double total = 0.0;
+		double simplification = 0.0;
+		contouring::ExtractionCounters counters;
+		size_t verticesBeforeSimplification = 0;
+		size_t verticesAfterSimplification = 0;
+		// Blocks found changed in temporal coherence mode
+		size_t changedBlocks = 0;
+
+		Profile& operator+=(const Profile& other);
+	};
+	// Extraction running on a background thread, the slice caches belong to it until
+	// it is done. The flags are only touched on the main thread.
+	struct BackgroundJob
+	{
+		std::atomic<bool> cancel{ false };
+		// Inputs the job was started with
+		std::weak_ptr<const Volume> volume;
+		size3_t dims;
+		size_t zBegin;
+		size_t zEnd;
+		ExtractionState state;
+		std::vector<double> isoValues;
+		std::vector<double> missing;
+		std::vector<double> bandIsoValues;
+		bool bands;
+		size_t previewStride;
+		// Contours and bands of all isovalues on the subsampled slices
+		std::vector<SliceCache> preview;
+		Profile profile;
+		std::string error;
+		bool previewReady = false;
+		bool previewShown = false;
+		bool done = false;
+		// The processor is gone, notifications of the job are dropped
+		bool orphaned = false;
+	};
 
 //Construction / Deconstruction
 public:
     MarchingSquares();
-    virtual ~MarchingSquares() = default;
+    virtual ~MarchingSquares();
 
 //Methods
 public:
     virtual const ProcessorInfo getProcessorInfo() const override;
     static const ProcessorInfo processorInfo_;
-	const double gaussian(int x, int y, float sigma);
 
 protected:
     ///Our main computation function
@@ -73,22 +264,139 @@ protected:
 
     // (TODO: Helper functions can be defined here and then implemented in the .cpp)
 
-    // Get the input value from a 2-dimensional scalar field represented by a 3-dimensional volume
-    double getInputValue(const VolumeRAM* data, const size3_t dims, 
-        const size_t i, const size_t j);
-  
-    // Draw a line segment from v1 to v2 with a color
-    void drawLineSegment(const vec2& v1, const vec2& v2, const vec4& color,
-        IndexBufferRAM* indexBuffer, std::vector<BasicMesh::Vertex>& vertices);
-	
-	// Draw isolines in cell ix, iy
-	void drawSingleIsoline(float ix, float iy, const double c, const vec4& color, const VolumeRAM* vr,
-		const size3_t dims, IndexBufferRAM* isoBufferGrid, std::vector<BasicMesh::Vertex>& vertices);
+	// Extract the contours of the volume on the inport
+	void processVolume();
+
+	// Extraction mode the contours are made with, simplification needs polylines
+	// so line segments are then extracted as polylines
+	int extractionMode() const;
+
+	// True if the contours are kept in pieces that are updated where a new frame changed
+	bool temporalCoherence() const;
+
+	// True if the bands between the multiple contours are filled
+	bool showBands() const;
+
+	// Property state the contours are extracted with
+	ExtractionState extractionState() const;
+
+	// Slices [zBegin, zEnd) of a volume of dims selected by the slice properties
+	void selectSlices(const size3_t& dims, size_t& zBegin, size_t& zEnd) const;
+
+	// Pick up the result of the background extraction if it is done. Otherwise the job is
+	// cancelled if the inputs changed since it started, or its preview is shown once it is
+	// there. Returns true if there is no job and the caches are free to use.
+	bool pollBackgroundJob();
+
+	// Extract the ascending isovalues missing and the bands between bandIsoValues of the
+	// slices [zBegin, zEnd) of vol on a background thread, with a preview of isoValues first
+	void startBackgroundJob(const std::shared_ptr<const Volume>& vol, const size3_t& dims, size_t zBegin,
+		size_t zEnd, const std::vector<double>& isoValues, const std::vector<double>& missing,
+		const std::vector<double>& bandIsoValues);
+
+	// Extract all isovalues (and bands) of the job on every slice subsampled by its preview
+	// stride, first is the view of the first slice and the others follow it in memory
+	template <typename T>
+	void extractPreview(const contouring::FieldView<T>& first, BackgroundJob& job);
+
+    // Draw a line segment from v1 to v2
+    // (at height z), the color is given by the color range of the vertices
+    void drawLineSegment(const vec2& v1, const vec2& v2, std::vector<std::uint32_t>& indices,
+        std::vector<vec3>& positions, float z = 0.0f);
+
+	// Extract the contours of the raw file selected by the streaming properties
+	void processStreaming();
+
+	// Bring the cached contours and the mesh up to date for a field of the given
+	// dimensions and output the mesh. extractMissing is called with all ascending
+	// isovalues, those that have no contours yet, and the isovalues whose bands have
+	// to be extracted (empty if the bands are up to date or not shown). It returns
+	// false if the contours are extracted in the background, the mesh is then left
+	// as it is.
+	void updateContours(const size3_t& dims, const std::function<bool(const std::vector<double>&,
+		const std::vector<double>&, const std::vector<double>&)>& extractMissing);
+
+	// Collect the isovalues selected by the properties in ascending order, and their colors
+	void collectIsovalues(std::vector<double>& isoValues, std::vector<vec4>& isoColors) const;
+
+	// Collect the colors of the bands between the ascending isovalues if they are shown
+	void collectBandColors(const std::vector<double>& isoValues, std::vector<vec4>& bandColors) const;
+
+	// Extract the ascending isovalues [begin, end) on every cached slice, first is
+	// the view of the first slice and the others follow it in memory. The bands
+	// between bandIsoValues are extracted as well unless it is empty. The time taken
+	// is added to profile. Once cancel is set, the slices not started yet are left
+	// out, and the filter and the kernels stop early. What they leave incomplete is
+	// not cached.
+	template <typename T>
+	void extractSlices(const contouring::FieldView<T>& first, const double* begin, const double* end,
+		const std::vector<double>& bandIsoValues, const ExtractionState& state, Profile& profile,
+		const std::atomic<bool>* cancel = nullptr);
+
+	// Extract the ascending isovalues [begin, end) into the level cache of one slice,
+	// all of them in one sweep over the cells. The time taken is added to profile. If
+	// cancel is set while the kernels run, the levels are not added to the cache.
+	template <typename T>
+	void extractLevels(const contouring::FieldView<T>& field, SliceCache& slice,
+		const double* begin, const double* end, const ExtractionState& state, size_t numThreads,
+		Profile& profile, const std::atomic<bool>* cancel = nullptr);
 
-	void drawIsolineSingleValue(const double c, const vec4& color, const VolumeRAM* vr, const size3_t dims, IndexBufferRAM* isoBufferGrid,
-		std::vector<BasicMesh::Vertex>& vertices);
+	// Bring every cached slice up to date for a new frame of the same size in temporal
+	// coherence mode, first is the view of the first slice and the others follow it in
+	// memory. Returns false if the frame changed too much and the caches have to be rebuilt.
+	template <typename T>
+	bool updateSlices(const contouring::FieldView<T>& first);
 
-	VolumeRAM* gaussianSmoothing(const VolumeRAM* vr, VolumeRAM* vrSmoothed, const size3_t dims, float sigma, const int radius);
+	// Extract the pieces flagged in dirty of the ascending isovalues [begin, end), which
+	// are in the level cache of the slice, and join them into the geometry of the levels.
+	// Once cancel is set the pieces are left incomplete and not joined.
+	template <typename T>
+	void extractPieces(const contouring::FieldView<T>& field, SliceCache& slice, const double* begin,
+		const double* end, const std::vector<std::uint8_t>& dirty, const ExtractionState& state,
+		size_t numThreads, Profile& profile, const std::atomic<bool>* cancel = nullptr);
+
+	// Update the cached grid line end points, returns true if they changed
+	bool updateGrid(const size3_t& dims);
+
+	// Rebuild the cached vertices and index buffers from the grid and the band and
+	// level caches of slices
+	void assembleMesh(const size3_t& dims, const std::vector<double>& isoValues,
+		const std::vector<vec4>& isoColors, const std::vector<vec4>& bandColors,
+		const std::vector<SliceCache>& slices);
+
+	// Overwrite the colors of the cached color ranges without touching the positions
+	void recolorMesh(const std::vector<vec4>& isoColors, const std::vector<vec4>& bandColors);
+
+	// Create the output mesh in the format selected by propMeshFormat from the cached
+	// positions, color ranges and index buffers
+	std::shared_ptr<Mesh> buildMesh();
+
+	// Fill the other set of the buffers handed out with the mesh from the cached positions
+	// and indices, after assembleMesh changed them
+	void updateMeshBuffers();
+
+	// Add the shared vertices of an isoline at height z and one strip index buffer holding all
+	// of its polylines, only the vertices kept by the simplification if it is on
+	void drawPolylines(const contouring::ContourGeometry& contour, float z);
+
+	// Close the index buffer of the mesh indices from begin on. Independent segments
+	// directly following other independent segments are added to their buffer.
+	void addLines(ConnectivityType connectivity, size_t begin);
+
+	// Add the triangles of a band at height z, they are appended to the triangle index
+	// buffer before them if there is one
+	void drawBand(const contouring::BandGeometry& band, float z);
+
+	// Smooth the field into the cached float buffer of the slice unless it is there already,
+	// and return a view of the result. stats is only written when the filter runs. If the
+	// filter is cancelled (see stats.cancelled) the buffer is cleared again.
+	template <typename T>
+	contouring::FieldView<float> gaussianSmoothing(const contouring::FieldView<T>& field,
+		SliceCache& slice, size_t numThreads, contouring::GaussianFilterStats& stats,
+		const std::atomic<bool>* cancel = nullptr) const;
+
+	// Show the profile of the last run in the statistics properties, and log it if asked to
+	void publishProfile();
 
 
 //Ports
@@ -104,7 +412,12 @@ public:
     // Basic settings
     BoolProperty propShowGrid;
     FloatVec4Property propGridColor;
+    BoolProperty propGridLod;
+    FloatProperty propGridSpacing;
     TemplateOptionProperty<int> propDeciderType;
+    TemplateOptionProperty<int> propExtraction;
+    TemplateOptionProperty<int> propSimplification;
+    FloatProperty propSimplifyTolerance;
     TemplateOptionProperty<int> propMultiple;
     // Properties for choosing a single iso contour by value
     FloatProperty propIsoValue;
@@ -112,12 +425,145 @@ public:
     // Properties for multiple iso contours 
     IntProperty propNumContours;
     TransferFunctionProperty propIsoTransferFunc;
+    BoolProperty propBands;
+    TemplateOptionProperty<int> propMeshFormat;
 	BoolProperty propApplyGaussian;
 	FloatProperty propSigma;
+	TemplateOptionProperty<int> propSlices;
+	IntMinMaxProperty propSliceRange;
+	IntProperty propThreads;
+	BoolProperty propBackground;
+	IntProperty propPreviewStride;
+	BoolProperty propTemporalCoherence;
+	BoolProperty propWorkingCopy;
+	// Streaming a raw file tile by tile
+	CompositeProperty propStreaming;
+	BoolProperty propStreamEnable;
+	FileProperty propStreamFile;
+	IntVec2Property propStreamDims;
+	TemplateOptionProperty<int> propStreamType;
+	IntSizeTProperty propStreamOffset;
+	IntProperty propStreamTileSize;
+#if LABMARCHINGSQUARES_PROFILING
+	// Read-only statistics of the last run
+	CompositeProperty propStatistics;
+	BoolProperty propStatisticsLog;
+	DoubleProperty propTimeFilter;
+	DoubleProperty propTimePyramid;
+	DoubleProperty propTimeExtraction;
+	DoubleProperty propTimeGrid;
+	DoubleProperty propTimeMesh;
+	DoubleProperty propTimeUpload;
+	DoubleProperty propTimeTotal;
+	DoubleProperty propTimeSimplification;
+	IntSizeTProperty propCellsScanned;
+	IntSizeTProperty propActiveCells;
+	IntSizeTProperty propAmbiguousAbove;
+	IntSizeTProperty propAmbiguousBelow;
+	IntSizeTProperty propSegments;
+	IntSizeTProperty propVertices;
+	IntSizeTProperty propBytesAllocated;
+	IntSizeTProperty propVerticesBeforeSimplification;
+	IntSizeTProperty propVerticesAfterSimplification;
+	IntSizeTProperty propChangedBlocks;
+#endif
 
 //Attributes
 private:
+	// Separable filter with the kernel precomputed for the current sigma
+	contouring::GaussianFilter filter_;
 
-};
+	// Input volume and filter settings the field caches below belong to
+	std::weak_ptr<const Volume> fieldVolume_;
+	bool fieldSmoothed_ = false;
+	float fieldSigma_ = 0.0f;
+	size3_t fieldDims_ = size3_t(0);
+
+	// Memory-mapped raw file and its layout while streaming, together with its value range
+	std::unique_ptr<contouring::RawFieldSource> streamSource_;
+	std::string streamFile_;
+	ivec2 streamDims_ = ivec2(0);
+	int streamType_ = -1;
+	size_t streamOffset_ = 0;
+	vec2 streamRange_ = vec2(0.0f);
+
+	// Slices [sliceBegin_, sliceBegin_ + slices_.size()) of the input, they all hold
+	// contours for the same isovalues
+	size_t sliceBegin_ = 0;
+	std::vector<SliceCache> slices_;
+	int levelsDecider_ = -1;
+	int levelsExtraction_ = -1;
+	bool levelsTemporal_ = false;
+
+	// Grid line end points for the grid dimensions gridDims_, drawing every
+	// gridStride_ line along x and y
+	std::vector<vec2> gridPoints_;
+	size3_t gridDims_ = size3_t(0);
+	size2_t gridStride_ = size2_t(0);
+
+	// Vertices [begin, end) that share one color
+	struct ColorRange
+	{
+		size_t begin;
+		size_t end;
+		vec4 color;
+	};
+	// Mesh indices [begin, end) that form one index buffer
+	struct LineIndices
+	{
+		DrawType drawType;
+		ConnectivityType connectivity;
+		size_t begin;
+		size_t end;
+	};
+	// Output mesh data, the bands (if shown) come first with one color range per band and slice,
+	// followed by the grid (if shown) and one color range per isovalue and slice.
+	// Only positions are cached, the vertex format is chosen when the mesh is handed out.
+	// The buffers keep their memory from one run to the next.
+	std::vector<vec3> meshPositions_;
+	std::vector<ColorRange> meshColors_;
+	std::vector<std::uint32_t> meshIndices_;
+	std::vector<LineIndices> meshLines_;
+	bool meshGrid_ = false;
+	bool meshBands_ = false;
+	size_t meshSlices_ = 0;
+	std::vector<double> meshIsoValues_;
+	int meshSimplification_ = 0;
+	float meshTolerance_ = 0.0f;
+	bool meshValid_ = false;
 
+	// Buffers handed out with the mesh. The positions are vec2 if all lines lie in z = 0.
+	struct MeshBuffers
+	{
+		std::shared_ptr<Buffer<vec2>> flatPositions;
+		std::shared_ptr<Buffer<vec3>> positions;
+		std::vector<std::shared_ptr<IndexBuffer>> indices;
+		// Normalized isovalues of the compact format for the isovalue range scalarRange
+		std::shared_ptr<Buffer<float>> scalars;
+		vec2 scalarRange = vec2(0.0f);
+		bool scalarsValid = false;
+		// Remaining vertex attributes of the full format, the colors change on their own
+		std::shared_ptr<Buffer<vec3>> normals;
+		std::shared_ptr<Buffer<vec3>> texcoords;
+		std::shared_ptr<Buffer<vec4>> colors;
+		bool attributesValid = false;
+		bool colorsValid = false;
+	};
+	// Two sets used in turn, they are filled only when the positions or indices changed.
+	// A buffer keeps its memory unless a mesh handed out still holds it.
+	MeshBuffers meshBuffers_[2];
+	size_t meshBufferSet_ = 0;
+	bool meshBuffersValid_ = false;
+
+	// Scratch buffers of drawPolylines
+	std::vector<std::uint8_t> keepScratch_;
+	std::vector<std::uint32_t> meshIndexScratch_;
+
+	// Statistics of the current run
+	Profile profile_;
+
+	// Extraction running in the background, if any, and its task on the thread pool
+	std::shared_ptr<BackgroundJob> job_;
+	std::future<void> jobTask_;
+};
 } // namespace
@@ -0,0 +1,198 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/profiling.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+// Decider for cells with four edge crossings, values match propDeciderType
+enum class Decider
+{
+    Midpoint = 0,
+    Asymptotic = 1
+};
+
+// Edges of the cell (ix, iy), in the order they are walked around the cell
+enum CellEdge
+{
+    EdgeLeft = 0,   // (ix, iy) to (ix, iy + 1)
+    EdgeTop = 1,    // (ix, iy + 1) to (ix + 1, iy + 1)
+    EdgeRight = 2,  // (ix + 1, iy + 1) to (ix + 1, iy)
+    EdgeBottom = 3  // (ix + 1, iy) to (ix, iy)
+};
+
+// Pair of cell edges connected by one isoline segment
+struct EdgePair
+{
+    int first;
+    int second;
+};
+
+// The cell contains part of the isoline if its values straddle c
+inline bool isActiveCell(float f00, float f01, float f11, float f10, double c)
+{
+    const float fmin = std::min({ f00, f01, f10, f11 });
+    const float fmax = std::max({ f00, f01, f10, f11 });
+    return fmin < c && fmax > c;
+}
+
+// First of the ascending isovalues [begin, end) that lies strictly above lo. The
+// isovalues of a cell or block with range [lo, hi] are those up to the first one
+// that is not below hi.
+inline const double* firstIsovalueAbove(float lo, const double* begin, const double* end)
+{
+    return std::upper_bound(begin, end, lo);
+}
+
+// Does any of the ascending isovalues [begin, end) lie strictly between lo and hi
+inline bool straddlesAny(float lo, float hi, const double* begin, const double* end)
+{
+    const double* it = firstIsovalueAbove(lo, begin, end);
+    return it != end && *it < hi;
+}
+
+// Segments of the isoline for one case index (see cellCase)
+struct CellCase
+{
+    int numSegments;
+    EdgePair segments[2];
+};
+
+// An edge is crossed if the bits of its two corners differ, the crossed edges are
+// paired in ascending order. Cases 5 and 10 have four crossings and list left/top
+// and right/bottom, the decider may connect left/bottom and top/right instead.
+constexpr CellCase cellCases[16] = {
+    { 0, { { 0, 0 }, { 0, 0 } } },
+    { 1, { { EdgeLeft, EdgeBottom }, { 0, 0 } } },
+    { 1, { { EdgeLeft, EdgeTop }, { 0, 0 } } },
+    { 1, { { EdgeTop, EdgeBottom }, { 0, 0 } } },
+    { 1, { { EdgeTop, EdgeRight }, { 0, 0 } } },
+    { 2, { { EdgeLeft, EdgeTop }, { EdgeRight, EdgeBottom } } },
+    { 1, { { EdgeLeft, EdgeRight }, { 0, 0 } } },
+    { 1, { { EdgeRight, EdgeBottom }, { 0, 0 } } },
+    { 1, { { EdgeRight, EdgeBottom }, { 0, 0 } } },
+    { 1, { { EdgeLeft, EdgeRight }, { 0, 0 } } },
+    { 2, { { EdgeLeft, EdgeTop }, { EdgeRight, EdgeBottom } } },
+    { 1, { { EdgeTop, EdgeRight }, { 0, 0 } } },
+    { 1, { { EdgeTop, EdgeBottom }, { 0, 0 } } },
+    { 1, { { EdgeLeft, EdgeTop }, { 0, 0 } } },
+    { 1, { { EdgeLeft, EdgeBottom }, { 0, 0 } } },
+    { 0, { { 0, 0 }, { 0, 0 } } },
+};
+
+// Case index of a cell, bit k is set if corner k of { f00, f01, f11, f10 } is not
+// below c. Samples are assumed not to be NaN.
+inline int cellCase(float f00, float f01, float f11, float f10, double c)
+{
+    return static_cast<int>(f00 >= c) | static_cast<int>(f01 >= c) << 1 |
+        static_cast<int>(f11 >= c) << 2 | static_cast<int>(f10 >= c) << 3;
+}
+
+// Find the segments of the isoline c within a cell with corner values f00 at
+// (ix, iy), f01 at (ix, iy + 1), f11 at (ix + 1, iy + 1) and f10 at (ix + 1, iy).
+// Returns the number of segments (0, 1 or 2) written to segments. Cells with
+// four crossings are resolved with the given decider.
+inline int cellSegments(float f00, float f01, float f11, float f10, double c, Decider decider,
+    EdgePair segments[2])
+{
+    const CellCase& cell = cellCases[cellCase(f00, f01, f11, f10, c)];
+    segments[0] = cell.segments[0];
+    segments[1] = cell.segments[1];
+    if (cell.numSegments != 2)
+    {
+        return cell.numSegments;
+    }
+
+    // Ambiguity, either left/top and right/bottom are connected or left/bottom and top/right
+    bool leftTop;
+    if (decider == Decider::Midpoint)
+    {
+        const float fc = 0.25 * (f00 + f01 + f10 + f11);
+        leftTop = ((fc < c) && (f00 < c)) || ((fc >= c) && (f00 >= c));
+    }
+    else
+    {
+        const float fab = (f00 * f11 - f10 * f01) / (f11 + f00 - f01 - f10);
+        leftTop = !(((c >= fab) && (f00 >= c)) || ((c < fab) && (f00 < c)));
+    }
+
+    if (!leftTop)
+    {
+        segments[0] = { EdgeLeft, EdgeBottom };
+        segments[1] = { EdgeTop, EdgeRight };
+    }
+    return 2;
+}
+
+// For a cell with two segments as returned by cellSegments, did the decider join
+// the two corners above c. Connecting left and top cuts off (ix, iy + 1) and
+// (ix + 1, iy), which joins f00 with its opposite corner.
+inline bool joinsCornersAbove(float f00, double c, const EdgePair segments[2])
+{
+    return (segments[0].second == EdgeTop) == (f00 >= c);
+}
+
+// Fraction of the way from the sample with value fa to the one with value fb
+// where the isoline c crosses the edge between them
+inline float edgeParameter(double c, float fa, float fb)
+{
+    return (c - fa) / (fb - fa);
+}
+
+// Point where the isoline c crosses the grid edge from the sample at (ex, ey) with value
+// fa in direction (dx, dy) to the sample with value fb, in normalized coordinates. All
+// kernels interpolate with it, so equal inputs give the same vertex everywhere.
+inline glm::vec2 edgePoint(double c, float fa, float fb, float ex, float ey, float dx, float dy,
+    float extentX, float extentY)
+{
+    const float t = edgeParameter(c, fa, fb);
+    return glm::vec2((ex + t * dx) / extentX, (ey + t * dy) / extentY);
+}
+
+// Point where the isoline c crosses the given edge of the cell (ix, iy) with corner values
+// f = { f00, f01, f11, f10 }, in normalized coordinates. The edge is walked in
+// the direction of CellEdge, so the result is the same as that of the original
+// per-cell implementation.
+inline glm::vec2 edgeCrossing(int edge, size_t ix, size_t iy, const float f[4], double c,
+    float extentX, float extentY)
+{
+    static const float corner[4][2] = { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } };
+    static const float dir[4][2] = { { 0, 1 }, { 1, 0 }, { 0, -1 }, { -1, 0 } };
+
+    return edgePoint(c, f[edge], f[(edge + 1) % 4], static_cast<float>(ix) + corner[edge][0],
+        static_cast<float>(iy) + corner[edge][1], dir[edge][0], dir[edge][1], extentX, extentY);
+}
+
+// Append the segment endpoints of the isoline c in cell (ix, iy) to points
+inline void appendCellSegments(size_t ix, size_t iy, float f00, float f01, float f11, float f10,
+    double c, Decider decider, float extentX, float extentY, std::vector<glm::vec2>& points,
+    ExtractionCounters& counters)
+{
+    EdgePair pairs[2];
+    const int numSegments = cellSegments(f00, f01, f11, f10, c, decider, pairs);
+    counters.countSegments(numSegments, numSegments == 2 && joinsCornersAbove(f00, c, pairs));
+    counters.countVertices(2 * numSegments);
+    const float f[] = { f00, f01, f11, f10 };
+    for (int s = 0; s < numSegments; s++)
+    {
+        points.push_back(edgeCrossing(pairs[s].first, ix, iy, f, c, extentX, extentY));
+        points.push_back(edgeCrossing(pairs[s].second, ix, iy, f, c, extentX, extentY));
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,114 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/minmaxpyramid.h>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+void MinMaxPyramid::clear()
+{
+    cellsX_ = 0;
+    cellsY_ = 0;
+    levels_.clear();
+}
+
+size_t MinMaxPyramid::getByteSize() const
+{
+    size_t bytes = 0;
+    for (const auto& level : levels_)
+    {
+        bytes += (level.min.capacity() + level.max.capacity()) * sizeof(float);
+    }
+    return bytes;
+}
+
+void MinMaxPyramid::buildCoarserLevels()
+{
+    while (levels_.back().nx > 1 || levels_.back().ny > 1)
+    {
+        const Level& fine = levels_.back();
+
+        Level coarse;
+        coarse.nx = (fine.nx + 1) / 2;
+        coarse.ny = (fine.ny + 1) / 2;
+        coarse.min.resize(coarse.nx * coarse.ny, std::numeric_limits<float>::max());
+        coarse.max.resize(coarse.nx * coarse.ny, std::numeric_limits<float>::lowest());
+
+        for (size_t y = 0; y < fine.ny; y++)
+        {
+            for (size_t x = 0; x < fine.nx; x++)
+            {
+                const size_t i = (y / 2) * coarse.nx + x / 2;
+                coarse.min[i] = std::min(coarse.min[i], fine.min[y * fine.nx + x]);
+                coarse.max[i] = std::max(coarse.max[i], fine.max[y * fine.nx + x]);
+            }
+        }
+
+        levels_.push_back(std::move(coarse));
+    }
+}
+
+void MinMaxPyramid::findActiveBlocks(double c, Order order, std::vector<Block>& blocks) const
+{
+    findActiveBlocks(&c, &c + 1, order, blocks);
+}
+
+void MinMaxPyramid::findActiveBlocks(const double* begin, const double* end, Order order,
+    std::vector<Block>& blocks) const
+{
+    blocks.clear();
+    if (levels_.empty()) return;
+
+    descend(levels_.size() - 1, 0, 0, begin, end, blocks);
+
+    if (order == Order::ColumnMajor)
+    {
+        std::sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b)
+        {
+            return a.x0 < b.x0 || (a.x0 == b.x0 && a.y0 < b.y0);
+        });
+    }
+    else
+    {
+        std::sort(blocks.begin(), blocks.end(), [](const Block& a, const Block& b)
+        {
+            return a.y0 < b.y0 || (a.y0 == b.y0 && a.x0 < b.x0);
+        });
+    }
+}
+
+void MinMaxPyramid::descend(size_t level, size_t bx, size_t by, const double* begin,
+    const double* end, std::vector<Block>& blocks) const
+{
+    const Level& l = levels_[level];
+    const size_t i = by * l.nx + bx;
+    // Same test as for a single cell, a block without an active cell can be skipped
+    if (!straddlesAny(l.min[i], l.max[i], begin, end)) return;
+
+    if (level == 0)
+    {
+        const size_t x0 = bx * blockSize;
+        const size_t y0 = by * blockSize;
+        blocks.push_back({ x0, y0, std::min(x0 + blockSize, cellsX_), std::min(y0 + blockSize, cellsY_) });
+        return;
+    }
+
+    const Level& finer = levels_[level - 1];
+    for (size_t y = 2 * by; y < std::min(2 * by + 2, finer.ny); y++)
+    {
+        for (size_t x = 2 * bx; x < std::min(2 * bx + 2, finer.nx); x++)
+        {
+            descend(level - 1, x, y, begin, end, blocks);
+        }
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo
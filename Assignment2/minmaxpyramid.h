@@ -0,0 +1,206 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/labmarchingsquaresmoduledefine.h>
+#include <labmarchingsquares/marchingsquarescell.h>
+#include <labmarchingsquares/parallelfor.h>
+#include <labmarchingsquares/scalarfield.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+/** Min/max pyramid over the cells of a 2D scalar field.
+
+    The finest level stores the value range of blocks of blockSize x blockSize
+    cells (including their corner samples), every coarser level merges 2 x 2
+    blocks of the level below. An isovalue query descends only into blocks
+    whose range straddles the isovalue, so its cost depends on the number of
+    active blocks rather than on the size of the grid.
+*/
+class IVW_MODULE_LABMARCHINGSQUARES_API MinMaxPyramid
+{
+//Types
+public:
+    // Number of cells per side of the finest blocks
+    static const size_t blockSize = 16;
+
+    // Cells [x0, x1) x [y0, y1) of one finest block
+    struct Block
+    {
+        size_t x0, y0, x1, y1;
+    };
+
+    enum class Order
+    {
+        ColumnMajor, // sorted by x0, then y0
+        RowMajor     // sorted by y0, then x0
+    };
+
+//Methods
+public:
+    template <typename T>
+    void build(const FieldView<T>& field, size_t numThreads = 0);
+
+    // Recompute the blocks that hold any of the cells [x0, x1) x [y0, y1) after
+    // field changed there, field has the size the pyramid was built for
+    template <typename T>
+    void update(const FieldView<T>& field, size_t x0, size_t y0, size_t x1, size_t y1);
+
+    void clear();
+    bool empty() const { return levels_.empty(); }
+
+    size_t getCellsX() const { return cellsX_; }
+    size_t getCellsY() const { return cellsY_; }
+    // Bytes held by the min and max values of all levels
+    size_t getByteSize() const;
+
+    // Collect the finest blocks that may contain cells with values below and above c
+    void findActiveBlocks(double c, Order order, std::vector<Block>& blocks) const;
+    // Same for any of the ascending isovalues [begin, end)
+    void findActiveBlocks(const double* begin, const double* end, Order order,
+        std::vector<Block>& blocks) const;
+
+private:
+    struct Level
+    {
+        size_t nx = 0;
+        size_t ny = 0;
+        std::vector<float> min;
+        std::vector<float> max;
+    };
+
+    // Value range of the cells of finest block (bx, by) including their corner samples
+    template <typename T>
+    void blockRange(const FieldView<T>& field, size_t bx, size_t by, float& lo, float& hi) const;
+
+    void buildCoarserLevels();
+    void descend(size_t level, size_t bx, size_t by, const double* begin, const double* end,
+        std::vector<Block>& blocks) const;
+
+//Attributes
+private:
+    size_t cellsX_ = 0;
+    size_t cellsY_ = 0;
+    // Finest level first, the last level has a single block
+    std::vector<Level> levels_;
+};
+
+template <typename T>
+void MinMaxPyramid::build(const FieldView<T>& field, size_t numThreads)
+{
+    clear();
+    if (field.nx < 2 || field.ny < 2) return;
+
+    cellsX_ = field.nx - 1;
+    cellsY_ = field.ny - 1;
+
+    Level finest;
+    finest.nx = (cellsX_ + blockSize - 1) / blockSize;
+    finest.ny = (cellsY_ + blockSize - 1) / blockSize;
+    finest.min.resize(finest.nx * finest.ny);
+    finest.max.resize(finest.nx * finest.ny);
+
+    parallelFor(finest.ny, numThreads, [&](size_t begin, size_t end, size_t)
+    {
+        for (size_t by = begin; by < end; by++)
+        {
+            for (size_t bx = 0; bx < finest.nx; bx++)
+            {
+                const size_t i = by * finest.nx + bx;
+                blockRange(field, bx, by, finest.min[i], finest.max[i]);
+            }
+        }
+    });
+
+    levels_.push_back(std::move(finest));
+    buildCoarserLevels();
+}
+
+template <typename T>
+void MinMaxPyramid::update(const FieldView<T>& field, size_t x0, size_t y0, size_t x1, size_t y1)
+{
+    if (levels_.empty() || x0 >= x1 || y0 >= y1) return;
+
+    // Blocks [bx0, bx1) x [by0, by1) of the current level
+    size_t bx0 = x0 / blockSize;
+    size_t by0 = y0 / blockSize;
+    size_t bx1 = (std::min(x1, cellsX_) + blockSize - 1) / blockSize;
+    size_t by1 = (std::min(y1, cellsY_) + blockSize - 1) / blockSize;
+    Level& finest = levels_.front();
+    for (size_t by = by0; by < by1; by++)
+    {
+        for (size_t bx = bx0; bx < bx1; bx++)
+        {
+            const size_t i = by * finest.nx + bx;
+            blockRange(field, bx, by, finest.min[i], finest.max[i]);
+        }
+    }
+
+    // Every coarser block is merged again from its 2 x 2 finer blocks
+    for (size_t level = 1; level < levels_.size(); level++)
+    {
+        const Level& fine = levels_[level - 1];
+        Level& coarse = levels_[level];
+        bx0 /= 2;
+        by0 /= 2;
+        bx1 = (bx1 + 1) / 2;
+        by1 = (by1 + 1) / 2;
+        for (size_t by = by0; by < by1; by++)
+        {
+            for (size_t bx = bx0; bx < bx1; bx++)
+            {
+                float lo = std::numeric_limits<float>::max();
+                float hi = std::numeric_limits<float>::lowest();
+                for (size_t y = 2 * by; y < std::min(2 * by + 2, fine.ny); y++)
+                {
+                    for (size_t x = 2 * bx; x < std::min(2 * bx + 2, fine.nx); x++)
+                    {
+                        lo = std::min(lo, fine.min[y * fine.nx + x]);
+                        hi = std::max(hi, fine.max[y * fine.nx + x]);
+                    }
+                }
+                coarse.min[by * coarse.nx + bx] = lo;
+                coarse.max[by * coarse.nx + bx] = hi;
+            }
+        }
+    }
+}
+
+template <typename T>
+void MinMaxPyramid::blockRange(const FieldView<T>& field, size_t bx, size_t by, float& lo,
+    float& hi) const
+{
+    // Cells [x0, x1) x [y0, y1) touch the samples [x0, x1] x [y0, y1]
+    const size_t x0 = bx * blockSize;
+    const size_t x1 = std::min(x0 + blockSize, cellsX_);
+    const size_t y0 = by * blockSize;
+    const size_t y1 = std::min(y0 + blockSize, cellsY_);
+
+    lo = std::numeric_limits<float>::max();
+    hi = std::numeric_limits<float>::lowest();
+    for (size_t y = y0; y <= y1; y++)
+    {
+        const T* row = field.row(y);
+        for (size_t x = x0; x <= x1; x++)
+        {
+            const float value = static_cast<float>(row[x]);
+            lo = std::min(lo, value);
+            hi = std::max(hi, value);
+        }
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,301 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+// Resolve a requested thread count (0 means one per hardware core) and never
+// use more threads than there are work items
+inline size_t resolveThreadCount(size_t requested, size_t numItems)
+{
+    size_t n = requested;
+    if (n == 0)
+    {
+        n = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    return std::max<size_t>(1, std::min(n, numItems));
+}
+
+// True if cancel is given and set. Long running loops check it between blocks of
+// work, stop early and leave their output empty or incomplete.
+inline bool isCancelled(const std::atomic<bool>* cancel)
+{
+    return cancel && cancel->load(std::memory_order_relaxed);
+}
+
+namespace detail
+{
+
+// Tasks [0, count) of one parallel call, run(context, task) runs one of them.
+// next is guarded by the mutex of the pool, error by the mutex of the job.
+struct PoolJob
+{
+    void (*run)(void*, size_t) = nullptr;
+    void* context = nullptr;
+    size_t count = 0;
+    size_t next = 0;
+    std::atomic<size_t> running{ 0 };
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::exception_ptr error;
+};
+
+// Threads kept for the whole process that help the calling thread with the tasks
+// of parallel calls. A call claims its tasks in order together with the pool
+// threads and runs every task no pool thread has taken itself, so a call made
+// from within a task, or while all pool threads are busy, cannot deadlock. The
+// pool grows to the largest number of threads any call asked for.
+class ThreadPool
+{
+//Construction / Deconstruction
+public:
+    static ThreadPool& instance()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_)
+        {
+            thread.join();
+        }
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+//Methods
+public:
+    // Call task(i) for every i in [0, count), task 0 on the calling thread. If a
+    // task throws, the call waits for the others and rethrows the first exception.
+    template <typename Task>
+    void run(size_t count, Task& task)
+    {
+        PoolJob job;
+        job.run = [](void* context, size_t i) { (*static_cast<Task*>(context))(i); };
+        job.context = &task;
+        job.count = count;
+        job.next = 1;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (threads_.size() + 1 < count)
+            {
+                threads_.emplace_back([this]() { work(); });
+            }
+            jobs_.push_back(&job);
+        }
+        wake_.notify_all();
+
+        for (size_t task = 0;;)
+        {
+            execute(job, task);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!claim(job, task)) break;
+        }
+
+        std::unique_lock<std::mutex> lock(job.mutex);
+        job.finished.wait(lock, [&job]() { return job.running == 0; });
+        if (job.error) std::rethrow_exception(job.error);
+    }
+
+private:
+    ThreadPool() = default;
+
+    // Take the next task of job, the pool must be locked. The job leaves the queue
+    // with its last task.
+    bool claim(PoolJob& job, size_t& task)
+    {
+        if (job.next == job.count) return false;
+        task = job.next++;
+        if (job.next == job.count)
+        {
+            jobs_.erase(std::find(jobs_.begin(), jobs_.end(), &job));
+        }
+        return true;
+    }
+
+    static void execute(PoolJob& job, size_t task)
+    {
+        try
+        {
+            job.run(job.context, task);
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (!job.error) job.error = std::current_exception();
+        }
+    }
+
+    // Loop of a pool thread, a claimed task is counted as running before the
+    // pool is unlocked, so the job outlives it
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;)
+        {
+            wake_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+            if (stop_) return;
+
+            PoolJob& job = *jobs_.front();
+            size_t task = 0;
+            claim(job, task);
+            job.running++;
+            lock.unlock();
+
+            execute(job, task);
+            {
+                std::lock_guard<std::mutex> jobLock(job.mutex);
+                if (--job.running == 0) job.finished.notify_all();
+            }
+            lock.lock();
+        }
+    }
+
+//Attributes
+private:
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<PoolJob*> jobs_;
+    std::vector<std::thread> threads_;
+    bool stop_ = false;
+};
+
+} // namespace detail
+
+// Split [0, numItems) into one contiguous range per thread and call
+// func(begin, end, threadIndex) for each range. Range t always gets thread
+// index t, the calling thread runs the first range and the threads of a pool
+// kept for the whole process the others, so no threads are started per call.
+// If func throws on any thread, the call waits for the other ranges and
+// rethrows the first exception on the calling thread.
+template <typename Func>
+void parallelFor(size_t numItems, size_t numThreads, Func&& func)
+{
+    if (numItems == 0) return;
+
+    const size_t threads = resolveThreadCount(numThreads, numItems);
+    const size_t chunk = (numItems + threads - 1) / threads;
+    const size_t numChunks = (numItems + chunk - 1) / chunk;
+    if (numChunks == 1)
+    {
+        func(size_t(0), numItems, size_t(0));
+        return;
+    }
+
+    auto task = [&](size_t t) { func(t * chunk, std::min(numItems, (t + 1) * chunk), t); };
+    detail::ThreadPool::instance().run(numChunks, task);
+}
+
+// Call func(item, threadIndex) for every item in [0, numItems). Each thread
+// starts on its own contiguous share of the items and, once that is done, steals
+// half of what is left of another thread's share. This keeps all threads busy
+// when the cost per item is very uneven. The calling thread is thread 0, the
+// others run on the pool of parallelFor. Exceptions are passed on like for
+// parallelFor.
+template <typename Func>
+void parallelForEach(size_t numItems, size_t numThreads, Func&& func)
+{
+    if (numItems == 0) return;
+
+    const size_t threads = resolveThreadCount(numThreads, numItems);
+    if (threads == 1)
+    {
+        for (size_t item = 0; item < numItems; item++)
+        {
+            func(item, size_t(0));
+        }
+        return;
+    }
+
+    // Items [begin, end) still to be done by a thread, on the stack for the
+    // usual thread counts
+    struct Share
+    {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+    Share localShares[16];
+    std::unique_ptr<Share[]> heapShares;
+    Share* shares = localShares;
+    if (threads > 16)
+    {
+        heapShares.reset(new Share[threads]);
+        shares = heapShares.get();
+    }
+    const size_t chunk = (numItems + threads - 1) / threads;
+    for (size_t t = 0; t < threads; t++)
+    {
+        shares[t].begin = std::min(numItems, t * chunk);
+        shares[t].end = std::min(numItems, shares[t].begin + chunk);
+    }
+
+    auto work = [&](size_t t)
+    {
+        Share& own = shares[t];
+        for (;;)
+        {
+            size_t item = numItems;
+            {
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (own.begin < own.end) item = own.begin++;
+            }
+            if (item < numItems)
+            {
+                func(item, t);
+                continue;
+            }
+
+            // Out of work, take the back half of the first thread that has some left
+            bool stolen = false;
+            for (size_t k = 1; k < threads && !stolen; k++)
+            {
+                Share& victim = shares[(t + k) % threads];
+                size_t begin = 0;
+                size_t end = 0;
+                {
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    const size_t left = victim.end - victim.begin;
+                    if (left == 0) continue;
+                    end = victim.end;
+                    begin = end - (left + 1) / 2;
+                    victim.end = begin;
+                }
+                std::lock_guard<std::mutex> lock(own.mutex);
+                own.begin = begin;
+                own.end = end;
+                stolen = true;
+            }
+            if (!stolen) return;
+        }
+    };
+
+    detail::ThreadPool::instance().run(threads, work);
+}
+
+} // namespace contouring
+} // namespace inviwo
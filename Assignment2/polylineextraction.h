@@ -0,0 +1,423 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/cellclassifier.h>
+#include <labmarchingsquares/contourgeometry.h>
+#include <labmarchingsquares/marchingsquarescell.h>
+#include <labmarchingsquares/minmaxpyramid.h>
+#include <labmarchingsquares/parallelfor.h>
+#include <labmarchingsquares/scalarfield.h>
+
+#include <algorithm>
+#include <atomic>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+namespace detail
+{
+
+// Link slot of a crossing on every CellEdge that holds the segment in the cell.
+// The cell on the left of or below an edge uses the first slot, the one on the
+// right or above the second, so linking only stores and does not read the slots.
+constexpr int edgeLink[4] = { 1, 0, 0, 1 };
+
+// Crossings on the horizontal edges at y = iy and y = iy + 1, and on the
+// vertical edges of row iy, for one isovalue. The slots are not cleared for
+// every row, a slot only holds a crossing of row iy if it is not below
+// rowBegin, the first vertex of the row, and one of row iy - 1 if it is not
+// below belowBegin. The vertices of the band are counted in numVertices, the
+// band's buffers are kept larger while it is extracted.
+struct EdgeCache
+{
+    std::vector<std::uint32_t> below;
+    std::vector<std::uint32_t> above;
+    std::vector<std::uint32_t> vertical;
+    std::uint32_t belowBegin = 0;
+    std::uint32_t rowBegin = 0;
+    std::uint32_t numVertices = 0;
+};
+
+// Extract the rows of the active blocks [firstBlock, lastBlock), sorted by block
+// row, for all isovalues as one band. The block rows do not need to be adjacent.
+// bands[level * bandStride] receives isovalue begin[level], what the extraction
+// did is added to counters. The classifier has to be reset for the isovalues
+// and rows of cellsX cells. If cancel is given, it is checked before every block
+// row, once it is set the band is left incomplete.
+template <typename T>
+void extractPolylineBand(const FieldView<T>& field, const double* begin, const double* end,
+    Decider decider, const MinMaxPyramid::Block* firstBlock, const MinMaxPyramid::Block* lastBlock,
+    std::vector<EdgeCache>& caches, RowClassifier& classifier, PolylineBand* bands, size_t bandStride,
+    ExtractionCounters& counters, const std::atomic<bool>* cancel = nullptr)
+{
+    const std::uint32_t none = noVertex;
+    const size_t numLevels = end - begin;
+    const size_t cellsX = field.nx - 1;
+    const float extentX = static_cast<float>(cellsX);
+    const float extentY = static_cast<float>(field.ny - 1);
+
+    const size_t firstRow = firstBlock->y0;
+    const size_t endRow = (lastBlock - 1)->y1;
+
+    // Caches kept from an earlier call hold vertices of another band, nothing is
+    // known about the row below the band
+    caches.resize(numLevels);
+    for (auto& cache : caches)
+    {
+        cache.below.assign(cellsX, none);
+        cache.above.assign(cellsX, none);
+        cache.vertical.assign(field.nx, none);
+        cache.belowBegin = 0;
+        cache.rowBegin = 0;
+        cache.numVertices = 0;
+    }
+    for (size_t level = 0; level < numLevels; level++)
+    {
+        PolylineBand& band = bands[level * bandStride];
+        band.clear();
+        band.firstRow = firstRow;
+        band.endRow = endRow;
+    }
+
+    // Counted locally, the counters of neighboring threads share cache lines
+    ExtractionCounters bandCounters;
+    // Cell (ix, iy) is cell i of the last classified row
+    auto processCell = [&](size_t ix, size_t iy, size_t i)
+    {
+        const float f00 = classifier.f00(i);
+        const float f01 = classifier.f01(i);
+        const float f11 = classifier.f11(i);
+        const float f10 = classifier.f10(i);
+
+        const float fmin = classifier.lo(i);
+        const float fmax = classifier.hi(i);
+        const float x = static_cast<float>(ix);
+        const float y = static_cast<float>(iy);
+        // Coordinates of the cell sides, the same as edgePoint gives along them
+        const float leftX = x / extentX;
+        const float rightX = (x + 1.0f) / extentX;
+        const float bottomY = y / extentY;
+        const float topY = (y + 1.0f) / extentY;
+
+        const double* first = firstIsovalueAbove(fmin, begin, end);
+        bandCounters.countActive(first != end && *first < fmax);
+        for (const double* c = first; c != end && *c < fmax; ++c)
+        {
+            EdgeCache& cache = caches[c - begin];
+            PolylineBand& band = bands[(c - begin) * bandStride];
+            // Room for the up to four new vertices of the cell
+            std::uint32_t n = cache.numVertices;
+            if (n + 4 > band.vertices.size())
+            {
+                band.vertices.resize(2 * band.vertices.size() + 256);
+                band.links.resize(band.vertices.size());
+            }
+            glm::vec2* const vertices = band.vertices.data();
+            VertexLinks* const links = band.links.data();
+
+            // Bit e is set if CellEdge e is crossed, its two corners lie on different sides of c
+            const int caseIndex = cellCase(f00, f01, f11, f10, *c);
+            const int crossed = caseIndex ^ (caseIndex >> 1 | (caseIndex & 1) << 3);
+            std::uint32_t vertex[4];
+
+            // The left and bottom crossings were created by the cells before, unless
+            // the row below was not extracted or such a cell had a corner equal to c
+            vertex[EdgeLeft] = cache.vertical[ix];
+            if ((crossed >> EdgeLeft & 1) &&
+                (vertex[EdgeLeft] < cache.rowBegin || vertex[EdgeLeft] == none))
+            {
+                vertices[n] = glm::vec2(leftX, (y + edgeParameter(*c, f00, f01)) / extentY);
+                links[n] = { { none, none } };
+                vertex[EdgeLeft] = n++;
+            }
+            vertex[EdgeBottom] = cache.below[ix];
+            if ((crossed >> EdgeBottom & 1) &&
+                (vertex[EdgeBottom] < cache.belowBegin || vertex[EdgeBottom] == none))
+            {
+                vertices[n] = glm::vec2((x + edgeParameter(*c, f00, f10)) / extentX, bottomY);
+                links[n] = { { none, none } };
+                vertex[EdgeBottom] = n++;
+                cache.below[ix] = vertex[EdgeBottom];
+            }
+
+            // The top and right crossings are always new. They are written behind the
+            // last vertex and only counted if the edge is crossed, which is as random
+            // as the field, a branch on it would be mispredicted half of the time.
+            const bool crossesTop = crossed >> EdgeTop & 1;
+            vertices[n] = glm::vec2((x + edgeParameter(*c, f01, f11)) / extentX, topY);
+            links[n] = { { none, none } };
+            vertex[EdgeTop] = crossesTop ? n : none;
+            n += crossesTop;
+            const bool crossesRight = crossed >> EdgeRight & 1;
+            vertices[n] = glm::vec2(rightX, (y + edgeParameter(*c, f10, f11)) / extentY);
+            links[n] = { { none, none } };
+            vertex[EdgeRight] = crossesRight ? n : none;
+            n += crossesRight;
+            cache.above[ix] = vertex[EdgeTop];
+            cache.vertical[ix + 1] = vertex[EdgeRight];
+            bandCounters.countVertices(n - cache.numVertices);
+            cache.numVertices = n;
+
+            EdgePair pairs[2];
+            const int numSegments = cellSegments(f00, f01, f11, f10, *c, decider, pairs);
+            bandCounters.countSegments(numSegments, numSegments == 2 && joinsCornersAbove(f00, *c, pairs));
+            for (int s = 0; s < numSegments; s++)
+            {
+                const int a = pairs[s].first;
+                const int b = pairs[s].second;
+                links[vertex[a]][edgeLink[a]] = vertex[b];
+                links[vertex[b]][edgeLink[b]] = vertex[a];
+            }
+        }
+    };
+
+    // Crossings in slots of the blocks [rowFirst, rowLast) that belong to the
+    // current row, as (cell column, vertex) of the seam
+    auto collectSeam = [&](const MinMaxPyramid::Block* rowFirst, const MinMaxPyramid::Block* rowLast,
+        const std::vector<std::uint32_t>& slots, std::uint32_t rowBegin,
+        std::vector<std::array<std::uint32_t, 2>>& seam)
+    {
+        for (const MinMaxPyramid::Block* block = rowFirst; block != rowLast; ++block)
+        {
+            for (size_t ix = block->x0; ix < block->x1; ix++)
+            {
+                if (slots[ix] != none && slots[ix] >= rowBegin)
+                {
+                    seam.push_back({ { static_cast<std::uint32_t>(ix), slots[ix] } });
+                }
+            }
+        }
+    };
+
+    size_t previousRow = firstRow;
+    for (const MinMaxPyramid::Block* rowFirst = firstBlock; rowFirst != lastBlock && !isCancelled(cancel);)
+    {
+        const MinMaxPyramid::Block* rowLast = rowFirst;
+        while (rowLast != lastBlock && rowLast->y0 == rowFirst->y0) ++rowLast;
+
+        for (size_t iy = rowFirst->y0; iy < rowFirst->y1; iy++)
+        {
+            // Crossings below a row that directly follows the last one are known
+            const bool belowKnown = iy != firstRow && iy == previousRow + 1;
+            for (auto& cache : caches)
+            {
+                cache.belowBegin = belowKnown ? cache.rowBegin : cache.numVertices;
+                cache.rowBegin = cache.numVertices;
+            }
+
+            for (const MinMaxPyramid::Block* block = rowFirst; block != rowLast; ++block)
+            {
+                const size_t numCells = block->x1 - block->x0;
+                const size_t numCandidates = classifier.classify(field, iy, block->x0, numCells);
+                bandCounters.countScanned(numCells);
+                for (size_t k = 0; k < numCandidates; k++)
+                {
+                    const size_t i = classifier.candidate(k);
+                    processCell(block->x0 + i, iy, i);
+                }
+            }
+
+            for (size_t level = 0; level < numLevels; level++)
+            {
+                EdgeCache& cache = caches[level];
+                PolylineBand& band = bands[level * bandStride];
+                if (iy == firstRow)
+                {
+                    collectSeam(rowFirst, rowLast, cache.below, cache.rowBegin, band.bottomSeam);
+                }
+                if (iy + 1 == endRow)
+                {
+                    collectSeam(rowFirst, rowLast, cache.above, cache.rowBegin, band.topSeam);
+                }
+                std::swap(cache.below, cache.above);
+            }
+            previousRow = iy;
+        }
+        rowFirst = rowLast;
+    }
+
+    for (size_t level = 0; level < numLevels; level++)
+    {
+        PolylineBand& band = bands[level * bandStride];
+        band.vertices.resize(caches[level].numVertices);
+        band.links.resize(caches[level].numVertices);
+        bandCounters.countBytes(vectorBytes(band.vertices) + vectorBytes(band.links) +
+            vectorBytes(band.bottomSeam) + vectorBytes(band.topSeam));
+    }
+    counters += bandCounters;
+}
+
+} // namespace detail
+
+// Buffers of extractPolylines that are kept between calls, so repeated extractions
+// reuse their memory instead of allocating it again
+struct PolylineWorkspace
+{
+    std::vector<MinMaxPyramid::Block> blocks;
+    std::vector<size_t> tasks;
+    std::vector<std::vector<detail::EdgeCache>> caches;
+    std::vector<RowClassifier> classifiers;
+    std::vector<PolylineBand> bands;
+    PolylineMergeScratch merge;
+    std::vector<ExtractionCounters> threadCounters;
+};
+
+/** Extract the isolines of the ascending isovalues [begin, end) as shared
+    vertices joined into polylines, out[level] receives isovalue begin[level].
+
+    Cells are visited row by row in a single sweep for all isovalues. Every grid
+    edge crossing is interpolated once and kept in a per-isovalue cache of two
+    rows of horizontal edges plus the vertical edges of the current row, so both
+    cells next to an edge refer to the same vertex, and every vertex links to the
+    up to two vertices it shares a segment with. With a pyramid built for the
+    same field, only its active blocks are visited. Each row of a block is
+    classified first (see RowClassifier) and only the candidate cells are
+    processed.
+
+    The block rows are split into one band per thread with about the same number
+    of active blocks, using numThreads threads (0 uses one per core). The bands
+    are merged in row order, joining the crossings on their seams, and the
+    vertices are walked along their links into open and closed polylines. The
+    result does not depend on the thread count. If counters is given, what the
+    extraction did is added to it. A workspace kept by the caller saves the
+    allocation of the edge caches, bands and merge buffers on repeated calls. If
+    cancel is given, it is checked before every block row. Once it is set the
+    sweep stops and out is left empty.
+*/
+template <typename T>
+void extractPolylines(const FieldView<T>& field, const double* begin, const double* end,
+    Decider decider, std::vector<ContourGeometry>& out, const MinMaxPyramid* pyramid = nullptr,
+    size_t numThreads = 0, ExtractionCounters* counters = nullptr, PolylineWorkspace* workspace = nullptr,
+    const std::atomic<bool>* cancel = nullptr)
+{
+    const size_t numLevels = end - begin;
+    out.resize(numLevels);
+    for (auto& contour : out)
+    {
+        contour.clear();
+    }
+    if (field.nx < 2 || field.ny < 2 || numLevels == 0) return;
+
+    const size_t cellsX = field.nx - 1;
+    const size_t cellsY = field.ny - 1;
+
+    PolylineWorkspace localWorkspace;
+    PolylineWorkspace& ws = workspace ? *workspace : localWorkspace;
+
+    auto& blocks = ws.blocks;
+    if (pyramid)
+    {
+        pyramid->findActiveBlocks(begin, end, MinMaxPyramid::Order::RowMajor, blocks);
+    }
+    else
+    {
+        blocks.assign(1, { 0, 0, cellsX, cellsY });
+    }
+
+    // Each task is a run of block rows with about the same number of active blocks,
+    // one per thread, given as its first active block
+    size_t numRows = 0;
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        if (b == 0 || blocks[b].y0 != blocks[b - 1].y0) numRows++;
+    }
+    const size_t threads = resolveThreadCount(numThreads, numRows);
+    auto& tasks = ws.tasks;
+    tasks.clear();
+    for (size_t b = 0; b < blocks.size(); b++)
+    {
+        const bool rowStart = b == 0 || blocks[b].y0 != blocks[b - 1].y0;
+        if (rowStart && b * threads >= tasks.size() * blocks.size()) tasks.push_back(b);
+    }
+    const size_t numTasks = tasks.size();
+    tasks.push_back(blocks.size());
+
+    auto& caches = ws.caches;
+    caches.resize(threads);
+    auto& classifiers = ws.classifiers;
+    classifiers.resize(threads);
+    for (auto& classifier : classifiers)
+    {
+        classifier.reset(cellsX, begin, end);
+    }
+    // Bands of one level are consecutive
+    auto& bands = ws.bands;
+    bands.resize(numLevels * numTasks);
+    auto& threadCounters = ws.threadCounters;
+    threadCounters.assign(threads, ExtractionCounters());
+
+    parallelForEach(numTasks, threads, [&](size_t task, size_t thread)
+    {
+        detail::extractPolylineBand(field, begin, end, decider, blocks.data() + tasks[task],
+            blocks.data() + tasks[task + 1], caches[thread], classifiers[thread], bands.data() + task,
+            numTasks, threadCounters[thread], cancel);
+    });
+
+    // The bands of a cancelled sweep are not all there, they are not merged
+    for (size_t level = 0; level < numLevels && !isCancelled(cancel); level++)
+    {
+        if (numTasks == 1)
+        {
+            // A single band is the contour already, its buffers are handed over
+            PolylineBand& band = bands[level];
+            std::swap(out[level].vertices, band.vertices);
+            stitchPolylines(band.links, out[level]);
+        }
+        else
+        {
+            mergePolylineBands(bands.data() + level * numTasks, numTasks, cellsX, out[level], &ws.merge);
+        }
+    }
+    if (isCancelled(cancel))
+    {
+        for (auto& contour : out)
+        {
+            contour.clear();
+        }
+    }
+
+    if (counters)
+    {
+        ExtractionCounters& total = *counters;
+        for (const auto& bandCounters : threadCounters)
+        {
+            total += bandCounters;
+        }
+        total.countBytes(vectorBytes(blocks) + vectorBytes(tasks));
+        for (const auto& cache : caches)
+        {
+            for (const auto& levelCache : cache)
+            {
+                total.countBytes(vectorBytes(levelCache.below) + vectorBytes(levelCache.above) +
+                    vectorBytes(levelCache.vertical));
+            }
+        }
+        for (const auto& contour : out)
+        {
+            total.countBytes(vectorBytes(contour.vertices) + vectorBytes(contour.indices) +
+                vectorBytes(contour.polylines));
+        }
+    }
+}
+
+// Extract the isolines of a single isovalue c as shared vertices joined into polylines
+template <typename T>
+void extractPolylines(const FieldView<T>& field, double c, Decider decider, ContourGeometry& out,
+    const MinMaxPyramid* pyramid = nullptr, size_t numThreads = 0)
+{
+    std::vector<ContourGeometry> contours(1);
+    std::swap(contours[0], out);
+    extractPolylines(field, &c, &c + 1, decider, contours, pyramid, numThreads);
+    std::swap(contours[0], out);
+}
+
+} // namespace contouring
+} // namespace inviwo
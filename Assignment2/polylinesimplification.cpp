@@ -0,0 +1,248 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/polylinesimplification.h>
+#include <labmarchingsquares/parallelfor.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <tuple>
+#include <utility>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+namespace
+{
+
+// Buffers reused for all polylines of one thread
+struct Scratch
+{
+    std::vector<glm::vec2> points;
+    std::vector<std::uint8_t> kept;
+    std::vector<std::pair<size_t, size_t>> ranges;
+    std::vector<size_t> prev;
+    std::vector<size_t> next;
+    std::vector<float> area;
+};
+
+// Squared distance of p to the segment from a to b
+float squaredDistance(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b)
+{
+    const glm::vec2 ab = b - a;
+    const float length2 = glm::dot(ab, ab);
+    float t = length2 > 0.0f ? glm::dot(p - a, ab) / length2 : 0.0f;
+    t = std::min(std::max(t, 0.0f), 1.0f);
+    const glm::vec2 d = p - (a + t * ab);
+    return glm::dot(d, d);
+}
+
+// Keep points[0] and points.back() and every point that is further than tolerance from
+// the segment between the kept points around it. A closed polyline repeats its first
+// point at the end, the point furthest from it is then kept first.
+void douglasPeucker(float tolerance, Scratch& scratch)
+{
+    const auto& points = scratch.points;
+    auto& kept = scratch.kept;
+    const float tolerance2 = tolerance * tolerance;
+
+    kept.front() = 1;
+    kept.back() = 1;
+    scratch.ranges.assign(1, { 0, points.size() - 1 });
+    while (!scratch.ranges.empty())
+    {
+        size_t a, b;
+        std::tie(a, b) = scratch.ranges.back();
+        scratch.ranges.pop_back();
+
+        size_t furthest = a;
+        float furthestDistance = tolerance2;
+        for (size_t k = a + 1; k < b; k++)
+        {
+            const float distance = squaredDistance(points[k], points[a], points[b]);
+            if (distance > furthestDistance)
+            {
+                furthest = k;
+                furthestDistance = distance;
+            }
+        }
+        if (furthest == a) continue;
+
+        kept[furthest] = 1;
+        scratch.ranges.push_back({ a, furthest });
+        scratch.ranges.push_back({ furthest, b });
+    }
+}
+
+// Repeatedly drop the point whose triangle with its neighbors has the smallest area,
+// as long as that area is below tolerance^2. Closed polylines are cyclic and keep at
+// least three points, open ones always keep their ends.
+void visvalingam(float tolerance, bool closed, Scratch& scratch)
+{
+    const auto& points = scratch.points;
+    auto& kept = scratch.kept;
+    auto& prev = scratch.prev;
+    auto& next = scratch.next;
+    auto& area = scratch.area;
+    const size_t n = points.size();
+    const float threshold = tolerance * tolerance;
+
+    prev.resize(n);
+    next.resize(n);
+    area.resize(n);
+    for (size_t k = 0; k < n; k++)
+    {
+        prev[k] = k > 0 ? k - 1 : n - 1;
+        next[k] = k + 1 < n ? k + 1 : 0;
+        kept[k] = 1;
+    }
+    auto triangleArea = [&](size_t k)
+    {
+        const glm::vec2 u = points[next[k]] - points[k];
+        const glm::vec2 v = points[prev[k]] - points[k];
+        return 0.5f * std::abs(u.x * v.y - u.y * v.x);
+    };
+
+    // Areas that no longer match area[k] are left in the queue and skipped
+    using Entry = std::pair<float, size_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+    const size_t first = closed ? 0 : 1;
+    const size_t last = closed ? n : n - 1;
+    for (size_t k = first; k < last; k++)
+    {
+        area[k] = triangleArea(k);
+        queue.push({ area[k], k });
+    }
+
+    size_t remaining = n;
+    const size_t minimum = closed ? 3 : 2;
+    while (!queue.empty() && remaining > minimum)
+    {
+        const Entry entry = queue.top();
+        queue.pop();
+        const size_t k = entry.second;
+        if (!kept[k] || entry.first != area[k]) continue;
+        if (entry.first >= threshold) break;
+
+        kept[k] = 0;
+        remaining--;
+        next[prev[k]] = next[k];
+        prev[next[k]] = prev[k];
+        // A neighbor never gets a smaller area than the point dropped before it
+        for (const size_t neighbor : { prev[k], next[k] })
+        {
+            if (!closed && (neighbor == 0 || neighbor == n - 1)) continue;
+            area[neighbor] = std::max(triangleArea(neighbor), entry.first);
+            queue.push({ area[neighbor], neighbor });
+        }
+    }
+}
+
+} // namespace
+
+size_t simplifyPolylines(const ContourGeometry& contour, Simplification method, float tolerance,
+    std::vector<std::uint8_t>& keep, size_t numThreads)
+{
+    keep.assign(contour.vertices.size(), 0);
+    const auto& lines = contour.polylines;
+
+    const size_t threads = resolveThreadCount(numThreads, lines.size());
+    std::vector<Scratch> scratch(threads);
+    parallelForEach(lines.size(), threads, [&](size_t l, size_t thread)
+    {
+        // Every vertex is part of one polyline only, so the threads write distinct flags
+        const Polyline& line = lines[l];
+        const std::uint32_t* indices = contour.indices.data() + line.begin;
+        const size_t n = line.size();
+        const size_t minimum = line.closed ? 3 : 2;
+        if (method == Simplification::None || n <= minimum)
+        {
+            for (size_t k = 0; k < n; k++) keep[indices[k]] = 1;
+            return;
+        }
+
+        Scratch& s = scratch[thread];
+        s.points.clear();
+        for (size_t k = 0; k < n; k++)
+        {
+            s.points.push_back(contour.vertices[indices[k]]);
+        }
+
+        if (method == Simplification::DouglasPeucker)
+        {
+            if (line.closed) s.points.push_back(s.points.front());
+            s.kept.assign(s.points.size(), 0);
+            douglasPeucker(tolerance, s);
+            if (line.closed)
+            {
+                s.points.pop_back();
+                s.kept.pop_back();
+                // A loop within tolerance of a point still keeps a triangle
+                if (std::count(s.kept.begin(), s.kept.end(), 1) < 3)
+                {
+                    s.kept[n / 3] = 1;
+                    s.kept[2 * n / 3] = 1;
+                }
+            }
+        }
+        else
+        {
+            s.kept.resize(n);
+            visvalingam(tolerance, line.closed, s);
+        }
+
+        for (size_t k = 0; k < n; k++)
+        {
+            keep[indices[k]] = s.kept[k];
+        }
+    });
+
+    return static_cast<size_t>(std::count(keep.begin(), keep.end(), 1));
+}
+
+size_t simplifyContour(ContourGeometry& contour, Simplification method, float tolerance,
+    size_t numThreads)
+{
+    if (method == Simplification::None) return contour.vertices.size();
+
+    std::vector<std::uint8_t> keep;
+    simplifyPolylines(contour, method, tolerance, keep, numThreads);
+
+    // Kept vertices move to the front in their order, remap holds their new index
+    std::vector<std::uint32_t> remap(contour.vertices.size());
+    size_t numKept = 0;
+    for (size_t v = 0; v < contour.vertices.size(); v++)
+    {
+        if (!keep[v]) continue;
+        remap[v] = static_cast<std::uint32_t>(numKept);
+        contour.vertices[numKept++] = contour.vertices[v];
+    }
+    contour.vertices.resize(numKept);
+
+    // The polylines keep their order, their kept indices move to the front as well
+    size_t n = 0;
+    for (auto& line : contour.polylines)
+    {
+        const size_t first = n;
+        for (size_t i = line.begin; i < line.end; i++)
+        {
+            const std::uint32_t index = contour.indices[i];
+            if (keep[index]) contour.indices[n++] = remap[index];
+        }
+        line.begin = first;
+        line.end = n;
+    }
+    contour.indices.resize(n);
+    return numKept;
+}
+
+} // namespace contouring
+} // namespace inviwo
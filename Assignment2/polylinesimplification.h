@@ -0,0 +1,51 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/labmarchingsquaresmoduledefine.h>
+#include <labmarchingsquares/contourgeometry.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+// Polyline simplification, values match propSimplification
+enum class Simplification
+{
+    None = 0,
+    // Keeps every vertex within tolerance of the simplified line
+    DouglasPeucker = 1,
+    // Drops vertices whose triangle with their neighbors has an area below tolerance^2
+    Visvalingam = 2
+};
+
+/** Decide which vertices of every polyline of contour are kept, keep[v] is
+    set to 1 for a kept vertex v and 0 otherwise. tolerance is given in the
+    normalized coordinates of the vertices.
+
+    The ends of open polylines are always kept, closed polylines keep at least
+    three vertices. The polylines are simplified independently and scheduled
+    over numThreads threads (0 uses one per core). Returns the number of kept
+    vertices.
+*/
+IVW_MODULE_LABMARCHINGSQUARES_API size_t simplifyPolylines(const ContourGeometry& contour,
+    Simplification method, float tolerance, std::vector<std::uint8_t>& keep, size_t numThreads = 0);
+
+/** Simplify the polylines of contour in place with simplifyPolylines, dropped
+    vertices are removed and the indices renumbered. Returns the number of
+    remaining vertices.
+*/
+IVW_MODULE_LABMARCHINGSQUARES_API size_t simplifyContour(ContourGeometry& contour,
+    Simplification method, float tolerance, size_t numThreads = 0);
+
+} // namespace contouring
+} // namespace inviwo
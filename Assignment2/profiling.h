@@ -0,0 +1,122 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+// Build with LABMARCHINGSQUARES_PROFILING=0 to remove all timers and counters,
+// the counting functions below are then empty and optimized away
+#ifndef LABMARCHINGSQUARES_PROFILING
+#define LABMARCHINGSQUARES_PROFILING 1
+#endif
+
+namespace inviwo
+{
+namespace contouring
+{
+
+// Bytes held by the elements of a vector, including its spare capacity
+template <typename T>
+size_t vectorBytes(const std::vector<T>& v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+/** What the extraction kernels did in one run. Every thread counts into its own
+    instance, the instances are summed when the threads are done.
+*/
+struct ExtractionCounters
+{
+    // Cells visited, cells in blocks skipped by the pyramid are not scanned
+    size_t cellsScanned = 0;
+    // Scanned cells crossed by at least one isoline
+    size_t activeCells = 0;
+    // Cells with four crossings of an isovalue, by whether the decider joined
+    // the two corners above or the two corners below the isovalue
+    size_t ambiguousJoinedAbove = 0;
+    size_t ambiguousJoinedBelow = 0;
+    size_t segments = 0;
+    size_t vertices = 0;
+    // Size of the buffers the kernels allocated, output included
+    size_t bytesAllocated = 0;
+
+#if LABMARCHINGSQUARES_PROFILING
+    void countScanned(size_t n) { cellsScanned += n; }
+    void countActive(bool active) { activeCells += active; }
+
+    // Segments of one isovalue in one cell, joinedAbove is only used for the
+    // two segments of an ambiguous cell (see joinsCornersAbove)
+    void countSegments(int numSegments, bool joinedAbove)
+    {
+        segments += numSegments;
+        if (numSegments == 2)
+        {
+            ambiguousJoinedAbove += joinedAbove;
+            ambiguousJoinedBelow += !joinedAbove;
+        }
+    }
+
+    void countVertices(size_t n) { vertices += n; }
+    void countBytes(size_t n) { bytesAllocated += n; }
+#else
+    void countScanned(size_t) {}
+    void countActive(bool) {}
+    void countSegments(int, bool) {}
+    void countVertices(size_t) {}
+    void countBytes(size_t) {}
+#endif
+
+    ExtractionCounters& operator+=(const ExtractionCounters& other)
+    {
+        cellsScanned += other.cellsScanned;
+        activeCells += other.activeCells;
+        ambiguousJoinedAbove += other.ambiguousJoinedAbove;
+        ambiguousJoinedBelow += other.ambiguousJoinedBelow;
+        segments += other.segments;
+        vertices += other.vertices;
+        bytesAllocated += other.bytesAllocated;
+        return *this;
+    }
+};
+
+/** Adds the wall time between its construction and destruction to a
+    millisecond total.
+*/
+class StageTimer
+{
+//Construction / Deconstruction
+public:
+#if LABMARCHINGSQUARES_PROFILING
+    explicit StageTimer(double& milliseconds)
+        : milliseconds_(milliseconds)
+        , start_(std::chrono::steady_clock::now())
+    {
+    }
+    ~StageTimer()
+    {
+        milliseconds_ +=
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+    }
+#else
+    explicit StageTimer(double&) {}
+#endif
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+//Attributes
+#if LABMARCHINGSQUARES_PROFILING
+private:
+    double& milliseconds_;
+    std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+} // namespace contouring
+} // namespace inviwo
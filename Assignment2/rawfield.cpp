@@ -0,0 +1,252 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/rawfield.h>
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace inviwo
+{
+namespace contouring
+{
+
+namespace
+{
+
+// Convert count samples of type T starting at src, which need not be aligned
+template <typename T>
+void convertSamples(const unsigned char* src, size_t count, float* dst)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        T value;
+        std::memcpy(&value, src + i * sizeof(T), sizeof(T));
+        dst[i] = static_cast<float>(value);
+    }
+}
+
+size_t pageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+} // namespace
+
+size_t rawTypeSize(RawType type)
+{
+    switch (type)
+    {
+    case RawType::Int8:
+    case RawType::UInt8: return 1;
+    case RawType::Int16:
+    case RawType::UInt16: return 2;
+    case RawType::Int32:
+    case RawType::UInt32:
+    case RawType::Float32: return 4;
+    case RawType::Float64: return 8;
+    }
+    return 0;
+}
+
+const char* rawTypeName(RawType type)
+{
+    switch (type)
+    {
+    case RawType::Int8: return "int8";
+    case RawType::UInt8: return "uint8";
+    case RawType::Int16: return "int16";
+    case RawType::UInt16: return "uint16";
+    case RawType::Int32: return "int32";
+    case RawType::UInt32: return "uint32";
+    case RawType::Float32: return "float32";
+    case RawType::Float64: return "float64";
+    }
+    return "";
+}
+
+bool parseRawType(const std::string& name, RawType& type)
+{
+    for (const RawType candidate : { RawType::Int8, RawType::UInt8, RawType::Int16, RawType::UInt16,
+        RawType::Int32, RawType::UInt32, RawType::Float32, RawType::Float64 })
+    {
+        if (name == rawTypeName(candidate))
+        {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path)
+{
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+    {
+        file_ = nullptr;
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file_);
+        throw std::runtime_error("Could not map the empty or unreadable file " + path);
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view)
+    {
+        if (mapping_) CloseHandle(mapping_);
+        CloseHandle(file_);
+        throw std::runtime_error("Could not map " + path);
+    }
+    data_ = static_cast<const unsigned char*>(view);
+}
+
+MappedFile::~MappedFile()
+{
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+}
+
+void MappedFile::release(size_t begin, size_t end)
+{
+    // Unlocking pages that are not locked removes them from the working set. A page
+    // shared with rows still in use is simply read again when it is touched.
+    const size_t page = pageSize();
+    begin = begin / page * page;
+    end = end / page * page;
+    if (begin < end)
+    {
+        VirtualUnlock(const_cast<unsigned char*>(data_) + begin, end - begin);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("Could not map the empty or unreadable file " + path);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+
+    void* view = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        throw std::runtime_error("Could not map " + path);
+    }
+    madvise(view, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const unsigned char*>(view);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<unsigned char*>(data_), size_);
+}
+
+void MappedFile::release(size_t begin, size_t end)
+{
+    // The mapping is never written, so a page shared with rows still in use is
+    // simply read from the file again when it is touched
+    const size_t page = pageSize();
+    begin = begin / page * page;
+    end = end / page * page;
+    if (begin < end)
+    {
+        madvise(const_cast<unsigned char*>(data_) + begin, end - begin, MADV_DONTNEED);
+    }
+}
+
+#endif
+
+RawFieldSource::RawFieldSource(const std::string& path, RawType type, size_t nx, size_t ny,
+    size_t offset)
+    : file_(path)
+    , type_(type)
+    , nx_(nx)
+    , ny_(ny)
+    , offset_(offset)
+{
+    if (offset_ + nx_ * ny_ * rawTypeSize(type_) > file_.size())
+    {
+        throw std::runtime_error(path + " is too small for the given dimensions and type");
+    }
+}
+
+void RawFieldSource::read(size_t x0, size_t y0, size_t w, size_t h, float* dst) const
+{
+    const size_t elementSize = rawTypeSize(type_);
+    for (size_t j = 0; j < h; j++)
+    {
+        const unsigned char* src = file_.data() + offset_ + ((y0 + j) * nx_ + x0) * elementSize;
+        float* row = dst + j * w;
+        switch (type_)
+        {
+        case RawType::Int8: convertSamples<std::int8_t>(src, w, row); break;
+        case RawType::UInt8: convertSamples<std::uint8_t>(src, w, row); break;
+        case RawType::Int16: convertSamples<std::int16_t>(src, w, row); break;
+        case RawType::UInt16: convertSamples<std::uint16_t>(src, w, row); break;
+        case RawType::Int32: convertSamples<std::int32_t>(src, w, row); break;
+        case RawType::UInt32: convertSamples<std::uint32_t>(src, w, row); break;
+        case RawType::Float32: convertSamples<float>(src, w, row); break;
+        case RawType::Float64: convertSamples<double>(src, w, row); break;
+        }
+    }
+}
+
+void RawFieldSource::release(size_t y)
+{
+    // A row below the previous one starts a new pass over the file
+    if (y < released_) released_ = 0;
+    if (y == released_) return;
+    const size_t rowSize = nx_ * rawTypeSize(type_);
+    file_.release(offset_ + released_ * rowSize, offset_ + y * rowSize);
+    released_ = y;
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,123 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/labmarchingsquaresmoduledefine.h>
+
+#include <cstddef>
+#include <string>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+/** 2D scalar field that is read piece by piece instead of being held in memory.
+
+    Implementations convert the samples to float. Readers for chunked file
+    formats only have to provide read(), release() is a hint that lets them
+    drop data that will not be read again.
+*/
+class IVW_MODULE_LABMARCHINGSQUARES_API TileSource
+{
+//Construction / Deconstruction
+public:
+    virtual ~TileSource() = default;
+
+//Methods
+public:
+    virtual size_t getWidth() const = 0;
+    virtual size_t getHeight() const = 0;
+
+    // Read the samples [x0, x0 + w) x [y0, y0 + h) into dst, w floats per row
+    virtual void read(size_t x0, size_t y0, size_t w, size_t h, float* dst) const = 0;
+
+    // Rows below y will not be read any more in the current pass over the field,
+    // a smaller y than before starts a new pass
+    virtual void release(size_t y) { (void)y; }
+};
+
+// Element types of raw files, stored in native byte order
+enum class RawType
+{
+    Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64
+};
+
+IVW_MODULE_LABMARCHINGSQUARES_API size_t rawTypeSize(RawType type);
+
+// Lower case name of type as given on the command line, like "float32"
+IVW_MODULE_LABMARCHINGSQUARES_API const char* rawTypeName(RawType type);
+
+// Type called name (see rawTypeName), returns false if there is none
+IVW_MODULE_LABMARCHINGSQUARES_API bool parseRawType(const std::string& name, RawType& type);
+
+/** Read-only memory mapping of a whole file.
+
+    Pages are only loaded when they are touched, and release() hands them back
+    to the operating system, so the resident size depends on the accessed part
+    of the file rather than on its size. Throws std::runtime_error if the file
+    cannot be mapped.
+*/
+class IVW_MODULE_LABMARCHINGSQUARES_API MappedFile
+{
+//Construction / Deconstruction
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+//Methods
+public:
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Drop the pages that hold the bytes [begin, end) from memory
+    void release(size_t begin, size_t end);
+
+//Attributes
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+/** Field of nx * ny samples of one raw type, stored x-fastest in a file after
+    offset bytes of header. The file is memory-mapped, read() converts the
+    requested samples only.
+*/
+class IVW_MODULE_LABMARCHINGSQUARES_API RawFieldSource : public TileSource
+{
+//Construction / Deconstruction
+public:
+    // Throws std::runtime_error if the file cannot be mapped or is too small
+    RawFieldSource(const std::string& path, RawType type, size_t nx, size_t ny, size_t offset = 0);
+
+//Methods
+public:
+    virtual size_t getWidth() const override { return nx_; }
+    virtual size_t getHeight() const override { return ny_; }
+    virtual void read(size_t x0, size_t y0, size_t w, size_t h, float* dst) const override;
+    virtual void release(size_t y) override;
+
+//Attributes
+private:
+    MappedFile file_;
+    RawType type_;
+    size_t nx_;
+    size_t ny_;
+    size_t offset_;
+    // Rows below this one have been released in the current pass
+    size_t released_ = 0;
+};
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,49 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+/** Read-only view of a 2D scalar field with element type T.
+
+    Samples are stored x-fastest, consecutive rows are rowStride elements
+    apart. Accessing a sample is a plain load from typed memory, there is no
+    bounds check, so callers have to stay within [0, nx) x [0, ny).
+*/
+template <typename T>
+struct FieldView
+{
+    using value_type = T;
+
+    FieldView() = default;
+    FieldView(const T* data, size_t nx, size_t ny)
+        : data(data), nx(nx), ny(ny), rowStride(nx) {}
+    FieldView(const T* data, size_t nx, size_t ny, size_t rowStride)
+        : data(data), nx(nx), ny(ny), rowStride(rowStride) {}
+
+    // Value at sample (i, j), converted the same way as VolumeRAM::getAsDouble followed by a float cast
+    float operator()(size_t i, size_t j) const
+    {
+        return static_cast<float>(data[j * rowStride + i]);
+    }
+
+    const T* row(size_t j) const { return data + j * rowStride; }
+
+    const T* data = nullptr;
+    size_t nx = 0;
+    size_t ny = 0;
+    size_t rowStride = 0;
+};
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,340 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/cellclassifier.h>
+#include <labmarchingsquares/marchingsquarescell.h>
+#include <labmarchingsquares/minmaxpyramid.h>
+#include <labmarchingsquares/parallelfor.h>
+#include <labmarchingsquares/scalarfield.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+namespace detail
+{
+
+// Cell columns [x0, x1) of the active blocks [firstBlock, lastBlock) of one block column
+struct SegmentTask
+{
+    size_t firstBlock, lastBlock;
+    size_t x0, x1;
+};
+
+// Classifier, candidate bits and candidate corners of the rows of the current
+// task, for one thread
+struct SegmentScratch
+{
+    RowClassifier classifier;
+    std::vector<std::uint8_t> candidates;
+    // Corners f00, f01, f11, f10 of the candidates in row order, and the index of
+    // the first candidate of every row
+    std::vector<std::array<float, 4>> corners;
+    std::vector<std::uint32_t> rowCorners;
+};
+
+} // namespace detail
+
+// Buffers of extractSegments that are kept between calls, so repeated extractions
+// reuse their memory instead of allocating it again
+struct SegmentWorkspace
+{
+    std::vector<MinMaxPyramid::Block> blocks;
+    std::vector<detail::SegmentTask> tasks;
+    std::vector<detail::SegmentScratch> scratch;
+    std::vector<ExtractionCounters> threadCounters;
+    // Per thread arenas, and the thread and range of points of every task and level
+    std::vector<std::vector<std::vector<glm::vec2>>> arenas;
+    std::vector<size_t> taskThread;
+    std::vector<size_t> taskBegin;
+    std::vector<size_t> taskEnd;
+};
+
+namespace detail
+{
+
+// Extract the active blocks ws.blocks, sorted column-major, like extractSegments and
+// append the points to segments[level]. Once cancel is set the tasks not started yet
+// are skipped, and segments is incomplete.
+template <typename T>
+void extractSegmentBlocks(const FieldView<T>& field, const double* begin, const double* end,
+    Decider decider, std::vector<std::vector<glm::vec2>>& segments, size_t numThreads,
+    ExtractionCounters* counters, SegmentWorkspace& ws, const std::atomic<bool>* cancel = nullptr)
+{
+    const size_t numLevels = end - begin;
+    const size_t cellsY = field.ny - 1;
+    const float extentX = static_cast<float>(field.nx - 1);
+    const float extentY = static_cast<float>(cellsY);
+    const auto& blocks = ws.blocks;
+
+    using Task = SegmentTask;
+    using Scratch = SegmentScratch;
+    // One candidate bit per column and row of a task, four columns fill one SSE register
+    const size_t columnsPerTask = 4;
+    static_assert(columnsPerTask <= 8, "The candidates of a task row are kept in 8 bits");
+    auto& tasks = ws.tasks;
+    tasks.clear();
+    for (size_t first = 0; first < blocks.size();)
+    {
+        size_t last = first;
+        while (last < blocks.size() && blocks[last].x0 == blocks[first].x0) last++;
+        for (size_t x0 = blocks[first].x0; x0 < blocks[first].x1; x0 += columnsPerTask)
+        {
+            tasks.push_back({ first, last, x0, std::min(x0 + columnsPerTask, blocks[first].x1) });
+        }
+        first = last;
+    }
+
+    auto runTask = [&](const Task& task, std::vector<std::vector<glm::vec2>>& out,
+        ExtractionCounters& threadCounters, Scratch& scratch)
+    {
+        // Counted locally, the counters of neighboring threads share cache lines
+        ExtractionCounters taskCounters;
+        const size_t numCells = task.x1 - task.x0;
+
+        // Bit ix - x0 of a row is set if cell ix of the row is a candidate. The corners
+        // of the candidates are kept as the rows are classified, so the column order
+        // below does not read the field again.
+        auto& candidates = scratch.candidates;
+        auto& corners = scratch.corners;
+        auto& rowCorners = scratch.rowCorners;
+        auto& classifier = scratch.classifier;
+        candidates.clear();
+        corners.clear();
+        rowCorners.clear();
+        for (size_t b = task.firstBlock; b < task.lastBlock; b++)
+        {
+            for (size_t iy = blocks[b].y0; iy < blocks[b].y1; iy++)
+            {
+                const size_t numCandidates = classifier.classify(field, iy, task.x0, numCells);
+                std::uint8_t bits = 0;
+                rowCorners.push_back(static_cast<std::uint32_t>(corners.size()));
+                for (size_t k = 0; k < numCandidates; k++)
+                {
+                    const size_t i = classifier.candidate(k);
+                    bits |= static_cast<std::uint8_t>(1u << i);
+                    corners.push_back({ { classifier.f00(i), classifier.f01(i), classifier.f11(i),
+                        classifier.f10(i) } });
+                }
+                candidates.push_back(bits);
+            }
+        }
+        taskCounters.countScanned(numCells * candidates.size());
+
+        for (size_t ix = task.x0; ix < task.x1; ix++)
+        {
+            const unsigned bit = 1u << (ix - task.x0);
+            size_t row = 0;
+            for (size_t b = task.firstBlock; b < task.lastBlock; b++)
+            {
+                for (size_t iy = blocks[b].y0; iy < blocks[b].y1; iy++, row++)
+                {
+                    const unsigned bits = candidates[row];
+                    if (!(bits & bit)) continue;
+
+                    // The candidates left of the cell come before it in its row
+                    const auto& cell = corners[rowCorners[row] + std::bitset<8>(bits & (bit - 1)).count()];
+                    const float f00 = cell[0];
+                    const float f01 = cell[1];
+                    const float f11 = cell[2];
+                    const float f10 = cell[3];
+
+                    const float fmin = std::min({ f00, f01, f10, f11 });
+                    const float fmax = std::max({ f00, f01, f10, f11 });
+                    const double* first = firstIsovalueAbove(fmin, begin, end);
+                    taskCounters.countActive(first != end && *first < fmax);
+                    for (const double* c = first; c != end && *c < fmax; ++c)
+                    {
+                        appendCellSegments(ix, iy, f00, f01, f11, f10, *c, decider, extentX, extentY,
+                            out[c - begin], taskCounters);
+                    }
+                }
+            }
+        }
+        threadCounters += taskCounters;
+    };
+
+    const size_t threads = resolveThreadCount(numThreads, tasks.size());
+    auto& threadCounters = ws.threadCounters;
+    threadCounters.assign(threads, ExtractionCounters());
+    auto& scratch = ws.scratch;
+    scratch.resize(threads);
+    for (auto& threadScratch : scratch)
+    {
+        threadScratch.classifier.reset(columnsPerTask, begin, end);
+        threadScratch.candidates.reserve(cellsY);
+        threadScratch.rowCorners.reserve(cellsY);
+    }
+    auto addCounters = [&]()
+    {
+        if (!counters) return;
+        threadCounters[0].countBytes(vectorBytes(blocks) + vectorBytes(tasks));
+        for (const auto& points : segments)
+        {
+            threadCounters[0].countBytes(vectorBytes(points));
+        }
+        for (const auto& taskCounters : threadCounters)
+        {
+            *counters += taskCounters;
+        }
+    };
+
+    if (threads == 1)
+    {
+        for (size_t task = 0; task < tasks.size() && !isCancelled(cancel); task++)
+        {
+            runTask(tasks[task], segments, threadCounters[0], scratch[0]);
+        }
+        addCounters();
+        return;
+    }
+
+    auto& arenas = ws.arenas;
+    arenas.resize(threads);
+    for (auto& arena : arenas)
+    {
+        arena.resize(numLevels);
+        for (auto& points : arena)
+        {
+            points.clear();
+        }
+    }
+    auto& taskThread = ws.taskThread;
+    auto& taskBegin = ws.taskBegin;
+    auto& taskEnd = ws.taskEnd;
+    taskThread.resize(tasks.size());
+    taskBegin.resize(tasks.size() * numLevels);
+    taskEnd.resize(tasks.size() * numLevels);
+
+    parallelForEach(tasks.size(), threads, [&](size_t task, size_t thread)
+    {
+        auto& arena = arenas[thread];
+        taskThread[task] = thread;
+        for (size_t level = 0; level < numLevels; level++)
+        {
+            taskBegin[task * numLevels + level] = arena[level].size();
+        }
+        if (!isCancelled(cancel))
+        {
+            runTask(tasks[task], arena, threadCounters[thread], scratch[thread]);
+        }
+        for (size_t level = 0; level < numLevels; level++)
+        {
+            taskEnd[task * numLevels + level] = arena[level].size();
+        }
+    });
+    if (isCancelled(cancel))
+    {
+        addCounters();
+        return;
+    }
+
+    // Merge in task order, which is the order of the serial scan
+    for (size_t level = 0; level < numLevels; level++)
+    {
+        size_t total = 0;
+        for (size_t task = 0; task < tasks.size(); task++)
+        {
+            total += taskEnd[task * numLevels + level] - taskBegin[task * numLevels + level];
+        }
+        auto& points = segments[level];
+        points.reserve(points.size() + total);
+        for (size_t task = 0; task < tasks.size(); task++)
+        {
+            const auto& arena = arenas[taskThread[task]][level];
+            points.insert(points.end(), arena.begin() + taskBegin[task * numLevels + level],
+                arena.begin() + taskEnd[task * numLevels + level]);
+        }
+    }
+
+    for (const auto& arena : arenas)
+    {
+        for (const auto& points : arena)
+        {
+            threadCounters[0].countBytes(vectorBytes(points));
+        }
+    }
+    addCounters();
+}
+
+} // namespace detail
+
+/** Extract the isolines of all ascending isovalues [begin, end) as independent
+    line segments in a single sweep over the cells.
+
+    For every cell the isovalues between its minimum and maximum are found by
+    binary search and only those are processed. segments[level] receives the
+    endpoint pairs of isovalue begin[level] in the same order as a scan over
+    that single isovalue would produce them: x-major over the cells, restricted
+    to the active blocks of the pyramid if one is given.
+
+    Every row of a task is classified first (see RowClassifier), only the
+    candidate cells are revisited in scan order to interpolate the crossings.
+    Their corners are kept from the classification, so the field is only read
+    in row order.
+
+    The scan is split into tasks of a few cell columns within one block column,
+    which are scheduled over numThreads threads (0 uses one per core). Every
+    thread appends to its own arena and the slices of the tasks are merged in
+    scan order afterwards, so the result does not depend on the thread count.
+    If counters is given, what the scan did is added to it. A workspace kept by
+    the caller saves the allocation of the scratch buffers on repeated calls.
+    If cancel is given, it is checked before every task. Once it is set the
+    scan stops and segments is left empty.
+*/
+template <typename T>
+void extractSegments(const FieldView<T>& field, const double* begin, const double* end,
+    Decider decider, const MinMaxPyramid* pyramid, std::vector<std::vector<glm::vec2>>& segments,
+    size_t numThreads = 0, ExtractionCounters* counters = nullptr, SegmentWorkspace* workspace = nullptr,
+    const std::atomic<bool>* cancel = nullptr)
+{
+    const size_t numLevels = end - begin;
+    segments.resize(numLevels);
+    for (auto& points : segments)
+    {
+        points.clear();
+    }
+    if (field.nx < 2 || field.ny < 2 || numLevels == 0) return;
+
+    const size_t cellsX = field.nx - 1;
+    const size_t cellsY = field.ny - 1;
+
+    SegmentWorkspace localWorkspace;
+    SegmentWorkspace& ws = workspace ? *workspace : localWorkspace;
+
+    auto& blocks = ws.blocks;
+    if (pyramid)
+    {
+        pyramid->findActiveBlocks(begin, end, MinMaxPyramid::Order::ColumnMajor, blocks);
+    }
+    else
+    {
+        blocks.assign(1, { 0, 0, cellsX, cellsY });
+    }
+
+    detail::extractSegmentBlocks(field, begin, end, decider, segments, numThreads, counters, ws, cancel);
+    if (isCancelled(cancel))
+    {
+        for (auto& points : segments)
+        {
+            points.clear();
+        }
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo
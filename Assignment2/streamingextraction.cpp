@@ -0,0 +1,343 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#include <labmarchingsquares/streamingextraction.h>
+#include <labmarchingsquares/cellclassifier.h>
+#include <labmarchingsquares/gaussianfilter.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+namespace
+{
+
+// Samples of one tile and its halo, smoothed if the stream is filtered
+struct Tile
+{
+    // Cells [x0, x1) x [y0, y1)
+    size_t x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    // Samples [sx0, sx0 + w) x [sy0, sy0 + h) held in values
+    size_t sx0 = 0, sy0 = 0, w = 0, h = 0;
+    std::vector<float> raw;
+    std::vector<float> values;
+    // Row pass of the filter, reused by every tile
+    std::vector<float> filtered;
+
+    float operator()(size_t i, size_t j) const { return values[(j - sy0) * w + (i - sx0)]; }
+    // Samples [x0, x1] of row j
+    const float* row(size_t j) const { return values.data() + (j - sy0) * w + (x0 - sx0); }
+};
+
+// Read the source tile by tile in row-major order and call func(tile) for each
+template <typename Func>
+StreamingStats forEachTile(TileSource& source, const StreamingSettings& settings, Func&& func)
+{
+    StreamingStats stats;
+#if LABMARCHINGSQUARES_PROFILING
+    const auto start = std::chrono::steady_clock::now();
+#endif
+
+    const size_t nx = source.getWidth();
+    const size_t ny = source.getHeight();
+    if (nx < 2 || ny < 2) return stats;
+    const size_t cellsX = nx - 1;
+    const size_t cellsY = ny - 1;
+    const size_t tileSize = std::max<size_t>(1, settings.tileSize);
+
+    // The halo gives the samples next to a tile border the full filter support
+    std::unique_ptr<GaussianFilter> filter;
+    size_t halo = 0;
+    if (settings.sigma > 0.0f)
+    {
+        filter.reset(new GaussianFilter(settings.sigma));
+        halo = static_cast<size_t>(filter->getRadius());
+    }
+
+    Tile tile;
+    for (size_t y0 = 0; y0 < cellsY; y0 += tileSize)
+    {
+        // Cells [y0, y1) touch the samples [y0, y1]
+        tile.y0 = y0;
+        tile.y1 = std::min(y0 + tileSize, cellsY);
+        tile.sy0 = y0 > halo ? y0 - halo : 0;
+        tile.h = std::min(tile.y1 + halo, ny - 1) + 1 - tile.sy0;
+
+        for (size_t x0 = 0; x0 < cellsX; x0 += tileSize)
+        {
+            tile.x0 = x0;
+            tile.x1 = std::min(x0 + tileSize, cellsX);
+            tile.sx0 = x0 > halo ? x0 - halo : 0;
+            tile.w = std::min(tile.x1 + halo, nx - 1) + 1 - tile.sx0;
+
+            const size_t samples = tile.w * tile.h;
+            tile.values.resize(samples);
+            if (filter)
+            {
+                tile.raw.resize(samples);
+                source.read(tile.sx0, tile.sy0, tile.w, tile.h, tile.raw.data());
+                filter->apply(tile.raw.data(), tile.values.data(), tile.w, tile.h, settings.numThreads,
+                    nullptr, &tile.filtered);
+            }
+            else
+            {
+                source.read(tile.sx0, tile.sy0, tile.w, tile.h, tile.values.data());
+            }
+
+            stats.tiles++;
+            stats.tileSamples = std::max(stats.tileSamples, samples);
+            func(static_cast<const Tile&>(tile));
+        }
+
+        // The next tile row reads from its first sample row minus the halo
+        source.release(tile.y1 > halo ? tile.y1 - halo : 0);
+    }
+    source.release(ny);
+    stats.counters.countBytes(
+        vectorBytes(tile.raw) + vectorBytes(tile.values) + vectorBytes(tile.filtered));
+
+#if LABMARCHINGSQUARES_PROFILING
+    stats.milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+#endif
+    return stats;
+}
+
+} // namespace
+
+StreamingStats streamPolylines(TileSource& source, const double* begin, const double* end,
+    const StreamingSettings& settings, std::vector<ContourGeometry>& out)
+{
+    const std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+    const size_t numLevels = end - begin;
+    out.assign(numLevels, ContourGeometry());
+    if (source.getWidth() < 2 || source.getHeight() < 2 || numLevels == 0) return StreamingStats();
+
+    const size_t cellsX = source.getWidth() - 1;
+    const float extentX = static_cast<float>(cellsX);
+    const float extentY = static_cast<float>(source.getHeight() - 1);
+    const size_t tileSize = std::max<size_t>(1, settings.tileSize);
+
+    // Crossing caches of one isovalue, the tile-local ones are indexed by cell column
+    // within the tile
+    struct LevelState
+    {
+        // Horizontal edges at the bottom of the current tile row, for every cell column
+        std::vector<std::uint32_t> bottom;
+        // Vertical edges on the right border of the previous tile, per row of the tile
+        std::vector<std::uint32_t> left;
+        // Horizontal edges at y = iy and y = iy + 1, vertical edges of row iy
+        std::vector<std::uint32_t> below;
+        std::vector<std::uint32_t> above;
+        std::vector<std::uint32_t> vertical;
+        // Links of the vertices of the isovalue's contour
+        std::vector<VertexLinks> links;
+    };
+    std::vector<LevelState> states(numLevels);
+    for (auto& state : states)
+    {
+        state.bottom.assign(cellsX, none);
+        state.left.assign(tileSize, none);
+    }
+    RowClassifier classifier;
+    classifier.reset(tileSize, begin, end);
+
+    ExtractionCounters counters;
+    StreamingStats stats = forEachTile(source, settings, [&](const Tile& tile)
+    {
+        const size_t tileCellsX = tile.x1 - tile.x0;
+        for (auto& state : states)
+        {
+            state.below.assign(state.bottom.begin() + tile.x0, state.bottom.begin() + tile.x1);
+        }
+
+        for (size_t iy = tile.y0; iy < tile.y1; iy++)
+        {
+            for (auto& state : states)
+            {
+                state.above.assign(tileCellsX, none);
+                state.vertical.assign(tileCellsX + 1, none);
+                // The left border of the first tile in a row is the border of the field
+                if (tile.x0 > 0) state.vertical[0] = state.left[iy - tile.y0];
+            }
+
+            const size_t numCandidates = classifier.classify(tile.row(iy), tile.row(iy + 1), tileCellsX);
+            counters.countScanned(tileCellsX);
+            for (size_t k = 0; k < numCandidates; k++)
+            {
+                const size_t local = classifier.candidate(k);
+                const size_t ix = tile.x0 + local;
+                const float f00 = classifier.f00(local);
+                const float f01 = classifier.f01(local);
+                const float f11 = classifier.f11(local);
+                const float f10 = classifier.f10(local);
+
+                const float fmin = classifier.lo(local);
+                const float fmax = classifier.hi(local);
+                const float x = static_cast<float>(ix);
+                const float y = static_cast<float>(iy);
+
+                const double* first = firstIsovalueAbove(fmin, begin, end);
+                counters.countActive(first != end && *first < fmax);
+                for (const double* c = first; c != end && *c < fmax; ++c)
+                {
+                    LevelState& state = states[c - begin];
+                    ContourGeometry& contour = out[c - begin];
+
+                    // Vertex where the edge from (ex, ey) with value fa in direction (dx, dy) crosses c
+                    auto edgeVertex = [&](std::uint32_t& slot, float fa, float fb, float ex, float ey,
+                        float dx, float dy)
+                    {
+                        if (slot == none)
+                        {
+                            slot = static_cast<std::uint32_t>(contour.vertices.size());
+                            contour.vertices.push_back(edgePoint(*c, fa, fb, ex, ey, dx, dy, extentX, extentY));
+                            state.links.push_back({ { none, none } });
+                            counters.countVertices(1);
+                        }
+                        return slot;
+                    };
+                    auto vertexOnEdge = [&](int edge)
+                    {
+                        switch (edge)
+                        {
+                        case EdgeLeft:
+                            return edgeVertex(state.vertical[local], f00, f01, x, y, 0.0f, 1.0f);
+                        case EdgeTop:
+                            return edgeVertex(state.above[local], f01, f11, x, y + 1.0f, 1.0f, 0.0f);
+                        case EdgeRight:
+                            return edgeVertex(state.vertical[local + 1], f10, f11, x + 1.0f, y, 0.0f, 1.0f);
+                        default:
+                            return edgeVertex(state.below[local], f00, f10, x, y, 1.0f, 0.0f);
+                        }
+                    };
+
+                    EdgePair pairs[2];
+                    const int numSegments = cellSegments(f00, f01, f11, f10, *c, settings.decider, pairs);
+                    counters.countSegments(numSegments, numSegments == 2 && joinsCornersAbove(f00, *c, pairs));
+                    for (int s = 0; s < numSegments; s++)
+                    {
+                        const std::uint32_t a = vertexOnEdge(pairs[s].first);
+                        linkVertices(state.links, a, vertexOnEdge(pairs[s].second));
+                    }
+                }
+            }
+
+            for (auto& state : states)
+            {
+                // The right border is the left border of the next tile in the row
+                state.left[iy - tile.y0] = state.vertical[tileCellsX];
+                std::swap(state.below, state.above);
+            }
+        }
+
+        // The top border is the bottom border of the tile above
+        for (auto& state : states)
+        {
+            std::copy(state.below.begin(), state.below.end(), state.bottom.begin() + tile.x0);
+        }
+    });
+
+    for (const auto& state : states)
+    {
+        counters.countBytes(vectorBytes(state.bottom) + vectorBytes(state.left) + vectorBytes(state.below) +
+            vectorBytes(state.above) + vectorBytes(state.vertical) + vectorBytes(state.links));
+    }
+    for (size_t level = 0; level < numLevels; level++)
+    {
+        stitchPolylines(states[level].links, out[level]);
+    }
+    for (const auto& contour : out)
+    {
+        counters.countBytes(vectorBytes(contour.vertices) + vectorBytes(contour.indices) +
+            vectorBytes(contour.polylines));
+    }
+    stats.counters += counters;
+    return stats;
+}
+
+StreamingStats streamSegments(TileSource& source, const double* begin, const double* end,
+    const StreamingSettings& settings, std::vector<std::vector<glm::vec2>>& out)
+{
+    const size_t numLevels = end - begin;
+    out.assign(numLevels, std::vector<glm::vec2>());
+    if (source.getWidth() < 2 || source.getHeight() < 2 || numLevels == 0) return StreamingStats();
+
+    const float extentX = static_cast<float>(source.getWidth() - 1);
+    const float extentY = static_cast<float>(source.getHeight() - 1);
+
+    ExtractionCounters counters;
+    RowClassifier classifier;
+    classifier.reset(std::max<size_t>(1, settings.tileSize), begin, end);
+    StreamingStats stats = forEachTile(source, settings, [&](const Tile& tile)
+    {
+        const size_t tileCellsX = tile.x1 - tile.x0;
+        for (size_t iy = tile.y0; iy < tile.y1; iy++)
+        {
+            const size_t numCandidates = classifier.classify(tile.row(iy), tile.row(iy + 1), tileCellsX);
+            counters.countScanned(tileCellsX);
+            for (size_t k = 0; k < numCandidates; k++)
+            {
+                const size_t local = classifier.candidate(k);
+                const size_t ix = tile.x0 + local;
+                const float f00 = classifier.f00(local);
+                const float f01 = classifier.f01(local);
+                const float f11 = classifier.f11(local);
+                const float f10 = classifier.f10(local);
+
+                const float fmin = classifier.lo(local);
+                const float fmax = classifier.hi(local);
+                const double* first = firstIsovalueAbove(fmin, begin, end);
+                counters.countActive(first != end && *first < fmax);
+                for (const double* c = first; c != end && *c < fmax; ++c)
+                {
+                    appendCellSegments(ix, iy, f00, f01, f11, f10, *c, settings.decider, extentX, extentY,
+                        out[c - begin], counters);
+                }
+            }
+        }
+    });
+
+    for (const auto& points : out)
+    {
+        counters.countBytes(vectorBytes(points));
+    }
+    stats.counters += counters;
+    return stats;
+}
+
+glm::vec2 findValueRange(TileSource& source, size_t rowsPerRead)
+{
+    const size_t nx = source.getWidth();
+    const size_t ny = source.getHeight();
+    if (nx == 0 || ny == 0) return glm::vec2(0.0f);
+
+    rowsPerRead = std::max<size_t>(1, rowsPerRead);
+    std::vector<float> rows(nx * std::min(rowsPerRead, ny));
+    float lo = std::numeric_limits<float>::max();
+    float hi = std::numeric_limits<float>::lowest();
+    for (size_t y0 = 0; y0 < ny; y0 += rowsPerRead)
+    {
+        const size_t h = std::min(rowsPerRead, ny - y0);
+        source.read(0, y0, nx, h, rows.data());
+        const auto range = std::minmax_element(rows.begin(), rows.begin() + nx * h);
+        lo = std::min(lo, *range.first);
+        hi = std::max(hi, *range.second);
+        source.release(y0 + h);
+    }
+    return glm::vec2(lo, hi);
+}
+
+} // namespace contouring
+} // namespace inviwo
@@ -0,0 +1,70 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/labmarchingsquaresmoduledefine.h>
+#include <labmarchingsquares/contourgeometry.h>
+#include <labmarchingsquares/marchingsquarescell.h>
+#include <labmarchingsquares/rawfield.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+struct StreamingSettings
+{
+    // Cells per side of a tile
+    size_t tileSize = 512;
+    // Standard deviation of the Gaussian pre-filter, no filtering if not positive
+    float sigma = 0.0f;
+    Decider decider = Decider::Midpoint;
+    // Threads for the filter, 0 uses one thread per core
+    size_t numThreads = 0;
+};
+
+struct StreamingStats
+{
+    size_t tiles = 0;
+    // Largest number of samples held for one tile, including its halo
+    size_t tileSamples = 0;
+    double milliseconds = 0.0;
+    ExtractionCounters counters;
+};
+
+/** Out-of-core extraction of the isolines of the ascending isovalues [begin, end).
+
+    The field is read tile by tile in row-major order. Every tile is read with
+    a halo of the Gaussian kernel radius, so the smoothed samples of a tile are
+    the same as those of filtering the whole field at once. Rows that no tile
+    needs any more are released from the source.
+
+    Memory for the field is bounded by the tile size. The crossings on the
+    top edges of the last tile row (one index per cell column and isovalue)
+    and the output itself are kept in addition.
+*/
+
+// Shared vertices joined into polylines, out[level] receives isovalue begin[level].
+// Crossings on tile seams are shared between the tiles on both sides.
+IVW_MODULE_LABMARCHINGSQUARES_API StreamingStats streamPolylines(TileSource& source,
+    const double* begin, const double* end, const StreamingSettings& settings,
+    std::vector<ContourGeometry>& out);
+
+// Independent segments as pairs of end points, out[level] receives isovalue begin[level]
+IVW_MODULE_LABMARCHINGSQUARES_API StreamingStats streamSegments(TileSource& source,
+    const double* begin, const double* end, const StreamingSettings& settings,
+    std::vector<std::vector<glm::vec2>>& out);
+
+// Smallest and largest sample of the source, read rowsPerRead rows at a time
+IVW_MODULE_LABMARCHINGSQUARES_API glm::vec2 findValueRange(TileSource& source, size_t rowsPerRead = 64);
+
+} // namespace contouring
+} // namespace inviwo
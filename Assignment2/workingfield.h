@@ -0,0 +1,188 @@
+/*********************************************************************
+ *  Project : KTH Inviwo Modules
+ *
+ *  License : Follows the Inviwo BSD license model
+ *********************************************************************
+ */
+
+#pragma once
+
+#include <labmarchingsquares/profiling.h>
+#include <labmarchingsquares/scalarfield.h>
+
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace inviwo
+{
+namespace contouring
+{
+
+/** Compact copy of one slice that the kernels read instead of the input.
+
+    The copy is made once per input and holds exactly the float values the
+    kernels would see in the input (see FieldView::operator()), so the contours
+    extracted from it are the same. It is only made where it is smaller than
+    the input or the input rows are not contiguous:
+
+    - Samples that are all integers within the range of int16 or uint16 are
+      kept in 16 bits. This is common for float or double volumes that hold
+      counts or scanner values, and for 32 bit integer volumes.
+    - Other double and 32 bit integer samples are kept as float.
+    - Float and 8 or 16 bit samples with contiguous rows are used in place.
+
+    The samples are stored x-fastest without padding, in the row order the
+    kernels sweep them. The copy is held in addition to the input, it narrows
+    the reads of the cell loops but does not shrink the memory footprint.
+*/
+class WorkingField
+{
+//Types
+public:
+    enum class Format
+    {
+        // No copy, the input is used in place
+        None,
+        Float,
+        UInt16,
+        Int16
+    };
+
+//Methods
+public:
+    // Make the copy of field if one pays off, otherwise clear it
+    template <typename T>
+    void build(const FieldView<T>& field);
+
+    void clear()
+    {
+        format_ = Format::None;
+        floats_.clear();
+        shorts_.clear();
+        nx_ = 0;
+        ny_ = 0;
+    }
+
+    Format getFormat() const { return format_; }
+    bool empty() const { return format_ == Format::None; }
+    size_t getByteSize() const { return vectorBytes(floats_) + vectorBytes(shorts_); }
+
+    // Call func with a view of the copy, returns false if there is none
+    template <typename Func>
+    bool dispatch(Func&& func) const;
+
+//Attributes
+private:
+    Format format_ = Format::None;
+    size_t nx_ = 0;
+    size_t ny_ = 0;
+    std::vector<float> floats_;
+    // Bits of the 16 bit samples, read as std::uint16_t or std::int16_t depending on format_
+    std::vector<std::uint16_t> shorts_;
+};
+
+namespace detail
+{
+
+// The smallest format that holds the float values of all samples of field exactly
+template <typename T>
+WorkingField::Format compactFormat(const FieldView<T>& field)
+{
+    // Integers of at most 16 bits are compact already
+    if (std::is_integral<T>::value && sizeof(T) <= 2)
+    {
+        return WorkingField::Format::None;
+    }
+
+    bool fitsUInt16 = true;
+    bool fitsInt16 = true;
+    for (size_t j = 0; j < field.ny && (fitsUInt16 || fitsInt16); j++)
+    {
+        for (size_t i = 0; i < field.nx; i++)
+        {
+            const float v = field(i, j);
+            // Also false for NaN
+            if (!(v == std::floor(v)))
+            {
+                fitsUInt16 = fitsInt16 = false;
+                break;
+            }
+            fitsUInt16 = fitsUInt16 && v >= 0.0f && v <= 65535.0f;
+            fitsInt16 = fitsInt16 && v >= -32768.0f && v <= 32767.0f;
+        }
+    }
+    if (fitsUInt16) return WorkingField::Format::UInt16;
+    if (fitsInt16) return WorkingField::Format::Int16;
+    // Float samples with contiguous rows can not get any smaller
+    if (std::is_same<T, float>::value && field.rowStride == field.nx)
+    {
+        return WorkingField::Format::None;
+    }
+    return WorkingField::Format::Float;
+}
+
+} // namespace detail
+
+template <typename T>
+void WorkingField::build(const FieldView<T>& field)
+{
+    clear();
+    format_ = detail::compactFormat(field);
+    if (format_ == Format::None) return;
+
+    nx_ = field.nx;
+    ny_ = field.ny;
+    auto copy = [&](auto* out, auto convert)
+    {
+        for (size_t j = 0; j < ny_; j++)
+        {
+            for (size_t i = 0; i < nx_; i++)
+            {
+                out[j * nx_ + i] = convert(field(i, j));
+            }
+        }
+    };
+    switch (format_)
+    {
+    case Format::Float:
+        floats_.resize(nx_ * ny_);
+        copy(floats_.data(), [](float v) { return v; });
+        break;
+    case Format::UInt16:
+        shorts_.resize(nx_ * ny_);
+        copy(shorts_.data(), [](float v) { return static_cast<std::uint16_t>(v); });
+        break;
+    default:
+        shorts_.resize(nx_ * ny_);
+        // Stored as the bits of the int16 value
+        copy(shorts_.data(), [](float v)
+        {
+            return static_cast<std::uint16_t>(static_cast<std::int16_t>(v));
+        });
+        break;
+    }
+}
+
+template <typename Func>
+bool WorkingField::dispatch(Func&& func) const
+{
+    switch (format_)
+    {
+    case Format::Float:
+        func(FieldView<float>(floats_.data(), nx_, ny_));
+        return true;
+    case Format::UInt16:
+        func(FieldView<std::uint16_t>(shorts_.data(), nx_, ny_));
+        return true;
+    case Format::Int16:
+        func(FieldView<std::int16_t>(reinterpret_cast<const std::int16_t*>(shorts_.data()), nx_, ny_));
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace contouring
+} // namespace inviwo